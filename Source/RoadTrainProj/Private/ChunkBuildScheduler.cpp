@@ -0,0 +1,171 @@
+
+#include "ChunkBuildScheduler.h"
+#include "RoadTrainProj.h" // stats
+
+#include "HAL/RunnableThread.h"
+#include "HAL/Event.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Build Queue Depth"), STAT_BuildQueueDepth, STATGROUP_RoadTrain);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Builds In Flight"), STAT_BuildsInFlight, STATGROUP_RoadTrain);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Build Latency (ms)"), STAT_BuildLatencyMs, STATGROUP_RoadTrain);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Build Worker Utilization (%)"), STAT_BuildWorkerUtilization, STATGROUP_RoadTrain);
+
+FChunkBuildScheduler::FChunkBuildScheduler(const int32& WorkerNum, const EThreadPriority& Priority)
+	: NextWorker(0), QueueDepth(0), BusyCycles(0)
+{
+	int32 Num = FMath::Max(WorkerNum, 1);
+	for (int32 i = 0; i < Num; i++) Workers.Add(MakeUnique<FChunkBuildWorker>(this, i, Priority));
+
+	LastStatsCycles = FPlatformTime::Cycles64();
+}
+
+FChunkBuildScheduler::~FChunkBuildScheduler()
+{
+	// joins every thread. jobs left in the queue are just thrown away.
+	Workers.Empty();
+}
+
+// heap order. true if A runs before B.
+static bool IsJobBefore(const float& PriorityA, const uint64& SequenceA, const float& PriorityB, const uint64& SequenceB)
+{
+	if (PriorityA != PriorityB) return PriorityA < PriorityB;
+	return SequenceA < SequenceB;
+}
+
+bool FChunkBuildScheduler::Enqueue(const FIntPoint& Chunk, const float& Priority, FJobWork&& Work)
+{
+	{
+		FScopeLock Lock(&InFlightMutex);
+		if (InFlight.Contains(Chunk)) return false;
+		InFlight.Add(Chunk);
+	}
+
+	// jobs of older passes stay in, a nearer chunk of a new pass still goes before them.
+	{
+		FScopeLock Lock(&JobsMutex);
+		Jobs.HeapPush(FJob{ Chunk, Priority, NextSequence++, FPlatformTime::Seconds(), MoveTemp(Work) },
+			[](const FJob& A, const FJob& B) { return IsJobBefore(A.Priority, A.Sequence, B.Priority, B.Sequence); });
+	}
+	QueueDepth++;
+
+	// one job, one worker. an idle one that misses it finds it on its next poll.
+	Workers[NextWorker++ % uint32(Workers.Num())]->Wake();
+	return true;
+}
+
+bool FChunkBuildScheduler::TryReserve(const FIntPoint& Chunk)
+{
+	FScopeLock Lock(&InFlightMutex);
+	if (InFlight.Contains(Chunk)) return false;
+	InFlight.Add(Chunk);
+	return true;
+}
+
+void FChunkBuildScheduler::Release(const FIntPoint& Chunk)
+{
+	FScopeLock Lock(&InFlightMutex);
+	InFlight.Remove(Chunk);
+}
+
+bool FChunkBuildScheduler::IsInFlight(const FIntPoint& Chunk)
+{
+	FScopeLock Lock(&InFlightMutex);
+	return InFlight.Contains(Chunk);
+}
+
+void FChunkBuildScheduler::UpdateStats()
+{
+	uint64 NowCycles = FPlatformTime::Cycles64();
+	uint64 Busy = BusyCycles;
+
+	uint64 Elapsed = (NowCycles - LastStatsCycles) * uint64(Workers.Num());
+	if (Elapsed > 0) Utilization = float(double(Busy - LastBusyCycles) / double(Elapsed)) * 100.0f;
+	LastStatsCycles = NowCycles;
+	LastBusyCycles = Busy;
+
+	int32 InFlightNum;
+	{
+		FScopeLock Lock(&InFlightMutex);
+		InFlightNum = InFlight.Num();
+	}
+	float LatencyMs;
+	{
+		FScopeLock Lock(&LatencyMutex);
+		LatencyMs = AverageLatencyMs;
+	}
+
+	SET_DWORD_STAT(STAT_BuildQueueDepth, QueueDepth);
+	SET_DWORD_STAT(STAT_BuildsInFlight, InFlightNum);
+	SET_FLOAT_STAT(STAT_BuildLatencyMs, LatencyMs);
+	SET_FLOAT_STAT(STAT_BuildWorkerUtilization, Utilization);
+}
+
+// every worker takes the most wanted job, whoever enqueued it.
+bool FChunkBuildScheduler::PopJob(FJob& OutJob)
+{
+	FScopeLock Lock(&JobsMutex);
+	if (Jobs.IsEmpty()) return false;
+
+	Jobs.HeapPop(OutJob, [](const FJob& A, const FJob& B) { return IsJobBefore(A.Priority, A.Sequence, B.Priority, B.Sequence); }, EAllowShrinking::No);
+	QueueDepth--;
+	return true;
+}
+
+void FChunkBuildScheduler::RunJob(FJob& Job)
+{
+	uint64 StartCycles = FPlatformTime::Cycles64();
+
+	bool Kept = Job.Work();
+	if (!Kept) Release(Job.Chunk);
+
+	BusyCycles += FPlatformTime::Cycles64() - StartCycles;
+
+	// enqueue -> done. includes time waiting in the queue.
+	float LatencyMs = float((FPlatformTime::Seconds() - Job.EnqueueTime) * 1000.0);
+	FScopeLock Lock(&LatencyMutex);
+	AverageLatencyMs = (AverageLatencyMs <= 0.0f) ? LatencyMs : FMath::Lerp(AverageLatencyMs, LatencyMs, 0.1f);
+}
+
+
+// --------------worker.
+
+FChunkBuildWorker::FChunkBuildWorker(FChunkBuildScheduler* pScheduler, const int32& Index, const EThreadPriority& Priority)
+	: pScheduler(pScheduler), Index(Index), ShouldStop(false)
+{
+	WorkEvent = FPlatformProcess::GetSynchEventFromPool(false);
+	Thread = FRunnableThread::Create(this, *FString::Printf(TEXT("ChunkBuildWorker%d"), Index), 0, Priority);
+}
+
+FChunkBuildWorker::~FChunkBuildWorker()
+{
+	if (Thread)
+	{
+		Thread->Kill(true); // calls Stop & waits.
+		delete Thread;
+		Thread = nullptr;
+	}
+	FPlatformProcess::ReturnSynchEventToPool(WorkEvent);
+	WorkEvent = nullptr;
+}
+
+void FChunkBuildWorker::Wake()
+{
+	WorkEvent->Trigger();
+}
+
+uint32 FChunkBuildWorker::Run()
+{
+	while (!ShouldStop)
+	{
+		FChunkBuildScheduler::FJob Job;
+		if (pScheduler->PopJob(Job)) pScheduler->RunJob(Job);
+		else WorkEvent->Wait(10); // ms. wakes on enqueue anyway.
+	}
+	return 0;
+}
+
+void FChunkBuildWorker::Stop()
+{
+	ShouldStop = true;
+	WorkEvent->Trigger();
+}
@@ -7,12 +7,155 @@
 #include "Containers/Map.h" // MultiMap
 
 #include "LandscapeManager.h"
+#include "HeightCache.h"	// FHeightTile
+#include "RoadField.h"
+
+#include "Math/VectorRegister.h" // SIMD noise
+#include "HAL/ThreadSingleton.h"   // build scratch
 
 #include <limits.h>
 const float INFLOAT = std::numeric_limits<float>::infinity(); // float INF for distance
 
+// batch height result should stay this close to scalar GetHeight. (cm)
+const float BatchHeightTolerance = 0.01f;
+
+// work arrays of one thread. build workers live as long as the scheduler, so it's one set per worker.
+// stages Reset (not Empty) what they use, memory stays for the next chunk.
+class FChunkScratch : public TThreadSingleton<FChunkScratch>
+{
+public:
+	// GetStreamSet. Triangles only has the path layer.
+	TArray<FVector3f> Vertices, Tangents, Normals;
+	TArray<uint32> Triangles;
+	TArray<FVector2DHalf> UVs;
+	// path layer before it's appended.
+	TArray<FVector3f> Vertices2, Tangents2, Normals2;
+	TArray<uint32> Triangles2;
+	TArray<FVector2DHalf> UVs2;
+	FRoadField Field;
+
+	TArray<int32> Coords;
+	TArray<int32> Border;
+
+	// GetPathStreamSetComponents
+	TArray<uint8> GridNeeded, DetailNeeded;
+	TArray<FVector2D> DetailLocations;
+	TArray<float> BatchHeights, DetailHeights;
+	TArray<int32> DetailIndices;
+	TArray<double> HeightSat;
+	TArray<int32> CountSat;
+
+	// GetHeights
+	TArray<FVector2D> Locations;
+	TArray<float> Xs, Ys, Heights;
+};
+
+// SIMD version of FMath::PerlinNoise2D. same table, same gradients, same float math.
+namespace ChunkNoise
+{
+	// Ken Perlin's reference permutation, doubled. (same one FMath::PerlinNoise2D uses)
+	static const int32 Permutation[512] = {
+		151,160,137,91,90,15,131,13,201,95,96,53,194,233,7,225,140,36,103,30,69,142,8,99,37,240,21,10,23,
+		190,6,148,247,120,234,75,0,26,197,62,94,252,219,203,117,35,11,32,57,177,33,88,237,149,56,87,174,20,125,136,171,168,
+		68,175,74,165,71,134,139,48,27,166,77,146,158,231,83,111,229,122,60,211,133,230,220,105,92,41,55,46,245,40,244,
+		102,143,54,65,25,63,161,1,216,80,73,209,76,132,187,208,89,18,169,200,196,135,130,116,188,159,86,164,100,109,198,173,186,
+		3,64,52,217,226,250,124,123,5,202,38,147,118,126,255,82,85,212,207,206,59,227,47,16,58,17,182,189,28,42,
+		223,183,170,213,119,248,152,2,44,154,163,70,221,153,101,155,167,43,172,9,129,22,39,253,19,98,108,110,79,113,224,232,178,185,
+		112,104,218,246,97,228,251,34,242,193,238,210,144,12,191,179,162,241,81,51,145,235,249,14,239,107,
+		49,192,214,31,181,199,106,157,184,84,204,176,115,121,50,45,127,4,150,254,138,236,205,93,222,114,67,29,24,72,243,141,128,195,78,66,215,61,156,180,
+
+		151,160,137,91,90,15,131,13,201,95,96,53,194,233,7,225,140,36,103,30,69,142,8,99,37,240,21,10,23,
+		190,6,148,247,120,234,75,0,26,197,62,94,252,219,203,117,35,11,32,57,177,33,88,237,149,56,87,174,20,125,136,171,168,
+		68,175,74,165,71,134,139,48,27,166,77,146,158,231,83,111,229,122,60,211,133,230,220,105,92,41,55,46,245,40,244,
+		102,143,54,65,25,63,161,1,216,80,73,209,76,132,187,208,89,18,169,200,196,135,130,116,188,159,86,164,100,109,198,173,186,
+		3,64,52,217,226,250,124,123,5,202,38,147,118,126,255,82,85,212,207,206,59,227,47,16,58,17,182,189,28,42,
+		223,183,170,213,119,248,152,2,44,154,163,70,221,153,101,155,167,43,172,9,129,22,39,253,19,98,108,110,79,113,224,232,178,185,
+		112,104,218,246,97,228,251,34,242,193,238,210,144,12,191,179,162,241,81,51,145,235,249,14,239,107,
+		49,192,214,31,181,199,106,157,184,84,204,176,115,121,50,45,127,4,150,254,138,236,205,93,222,114,67,29,24,72,243,141,128,195,78,66,215,61,156,180
+	};
+
+	// Grad2 as (X, Y) weights. Hash & 7 -> X, X+Y, Y, -X+Y, -X, -X-Y, -Y, X-Y
+	static const float GradX[8] = { 1.f, 1.f, 0.f, -1.f, -1.f, -1.f, 0.f, 1.f };
+	static const float GradY[8] = { 0.f, 1.f, 1.f, 1.f, 0.f, -1.f, -1.f, -1.f };
+
+	static FORCEINLINE VectorRegister4Float SmoothCurve(const VectorRegister4Float& X)
+	{
+		// X * X * X * (X * (X * 6 - 15) + 10)
+		VectorRegister4Float Inner = VectorSubtract(VectorMultiply(X, VectorSetFloat1(6.0f)), VectorSetFloat1(15.0f));
+		Inner = VectorAdd(VectorMultiply(X, Inner), VectorSetFloat1(10.0f));
+		return VectorMultiply(VectorMultiply(VectorMultiply(X, X), X), Inner);
+	}
+
+	static FORCEINLINE VectorRegister4Float Lerp(const VectorRegister4Float& A, const VectorRegister4Float& B, const VectorRegister4Float& Alpha)
+	{
+		return VectorAdd(A, VectorMultiply(Alpha, VectorSubtract(B, A)));
+	}
+
+	static FORCEINLINE VectorRegister4Float Grad(const float* GX, const float* GY, const VectorRegister4Float& X, const VectorRegister4Float& Y)
+	{
+		return VectorAdd(VectorMultiply(VectorLoadAligned(GX), X), VectorMultiply(VectorLoadAligned(GY), Y));
+	}
+
+	// OutHeights[i] += PerlinNoise2D( Xs[i], Ys[i] ) * Amplitude. Num should be multiple of 4.
+	static void AddPerlinNoise2D(const float* Xs, const float* Ys, const int32 Num, const float Amplitude, float* OutHeights)
+	{
+		const VectorRegister4Float One = VectorOneFloat();
+		const VectorRegister4Float Amp = VectorSetFloat1(Amplitude);
+
+		for (int32 i = 0; i < Num; i += 4)
+		{
+			VectorRegister4Float X = VectorLoad(Xs + i);
+			VectorRegister4Float Y = VectorLoad(Ys + i);
+			VectorRegister4Float FloorX = VectorFloor(X);
+			VectorRegister4Float FloorY = VectorFloor(Y);
+
+			alignas(16) float Xfl[4], Yfl[4];
+			VectorStoreAligned(FloorX, Xfl);
+			VectorStoreAligned(FloorY, Yfl);
+
+			// permutation lookups can't be vectorized without gather. do it per lane.
+			alignas(16) float G00X[4], G00Y[4], G10X[4], G10Y[4], G01X[4], G01Y[4], G11X[4], G11Y[4];
+			for (int32 Lane = 0; Lane < 4; Lane++)
+			{
+				int32 Xi = int32(Xfl[Lane]) & 255;
+				int32 Yi = int32(Yfl[Lane]) & 255;
+				int32 AA = Permutation[Xi] + Yi;
+				int32 AB = AA + 1;
+				int32 BA = Permutation[Xi + 1] + Yi;
+				int32 BB = BA + 1;
+
+				int32 H00 = Permutation[AA] & 7;
+				int32 H10 = Permutation[BA] & 7;
+				int32 H01 = Permutation[AB] & 7;
+				int32 H11 = Permutation[BB] & 7;
+
+				G00X[Lane] = GradX[H00]; G00Y[Lane] = GradY[H00];
+				G10X[Lane] = GradX[H10]; G10Y[Lane] = GradY[H10];
+				G01X[Lane] = GradX[H01]; G01Y[Lane] = GradY[H01];
+				G11X[Lane] = GradX[H11]; G11Y[Lane] = GradY[H11];
+			}
+
+			VectorRegister4Float FracX = VectorSubtract(X, FloorX);
+			VectorRegister4Float FracY = VectorSubtract(Y, FloorY);
+			VectorRegister4Float FracXm1 = VectorSubtract(FracX, One);
+			VectorRegister4Float FracYm1 = VectorSubtract(FracY, One);
+
+			VectorRegister4Float U = SmoothCurve(FracX);
+			VectorRegister4Float V = SmoothCurve(FracY);
+
+			VectorRegister4Float Noise = Lerp(
+				Lerp(Grad(G00X, G00Y, FracX, FracY), Grad(G10X, G10Y, FracXm1, FracY), U),
+				Lerp(Grad(G01X, G01Y, FracX, FracYm1), Grad(G11X, G11Y, FracXm1, FracYm1), U),
+				V);
+
+			VectorRegister4Float Sum = VectorAdd(VectorLoad(OutHeights + i), VectorMultiply(Noise, Amp));
+			VectorStore(Sum, OutHeights + i);
+		}
+	}
+}
+
 
-FChunkBuilder::FChunkBuilder( ALandscapeManager* pLM, UMaterialInterface* ChunkMaterial )
+FChunkBuilder::FChunkBuilder( ALandscapeManager* pLM, UMaterialInterface* ChunkMaterial ) : pLM( pLM )
 {
 	this->VertexSpacing = pLM->VertexSpacing;
 	this->VerticesPerChunk = pLM->VerticesPerChunk;
@@ -24,32 +167,55 @@ FChunkBuilder::FChunkBuilder( ALandscapeManager* pLM, UMaterialInterface* ChunkM
 	this->ChunkMaterial = ChunkMaterial;
 	this->CoverageRad = pLM->CoverageRadius;
 	this->DetailCount = pLM->DetailCount;
+	this->SmoothRadius = (pLM->RoadSmoothRadius > 0) ? pLM->RoadSmoothRadius : pLM->CoverageRadius;
+	this->MaxLOD = pLM->MaxChunkLOD;
+	this->SkirtDepth = pLM->LODSkirtDepth;
+	this->HorizonChunks = pLM->HorizonChunks;
+	this->HorizonCellsPerChunk = FMath::Max(pLM->HorizonCellsPerChunk, 1);
+	this->HorizonDrop = pLM->HorizonDrop;
+	this->UseCompactLayout = pLM->UseCompactLayout;
 
 	// need to be updated in LandscapeManager::OnConstruction()
 	ChunkLength = VertexSpacing * (VerticesPerChunk - 1); 
 	
+	UseBatchHeight = CheckBatchHeight();
 }
 
 // pass empty inpath if no path. should get all paths of neighbor chunks.
-void FChunkBuilder::GetStreamSet(const FIntPoint& Chunk, const TArray<FVector>& InPath, RealtimeMesh::FRealtimeMeshStreamSet& OutStreamSet)
+int32 FChunkBuilder::GetStreamSet(const FIntPoint& Chunk, const TArray<FVector>& InPath, RealtimeMesh::FRealtimeMeshStreamSet& OutStreamSet, const int32& LOD, FChunkMeshView* OutMesh)
 {
-	// actual data to use
-	TArray<FVector3f> Vertices, Tangents, Normals;
-	TArray<uint32> Triangles;
-	TArray<FVector2DHalf> UVs;
+	// actual data to use. Triangles only has the path layer, base grid topology comes from GetBaseTriangles.
+	FChunkScratch& Scratch = FChunkScratch::Get();
+	TArray<FVector3f>& Vertices = Scratch.Vertices;
+	TArray<FVector3f>& Tangents = Scratch.Tangents;
+	TArray<FVector3f>& Normals = Scratch.Normals;
+	TArray<uint32>& Triangles = Scratch.Triangles;
+	TArray<FVector2DHalf>& UVs = Scratch.UVs;
+	Triangles.Reset();
 
 	// gets mesh data for base chunk.
-	GetStreamSetComponents(Chunk, Vertices, Tangents, Normals, Triangles, UVs);
+	if (LOD <= 0) GetStreamSetComponents(Chunk, Vertices, Tangents, Normals, UVs);
+	else GetLODStreamSetComponents(Chunk, LOD, Vertices, Tangents, Normals, UVs);
 
-	if ( !InPath.IsEmpty() )
+	// hides T-junction cracks against a neighbor on another LOD. before the path layer, it's not on the edge.
+	if (MaxLOD > 0) AddSkirts(GetLODVertexCount(LOD), Vertices, Tangents, Normals, UVs);
+	FTrianglesPtr BaseTriangles = GetBaseTriangles(LOD);
+
+	if ( !InPath.IsEmpty() && LOD <= 0 )
 	{
+		// one distance field for both. lowering & blending read it.
+		FRoadField& Field = Scratch.Field;
+		MakeRoadField(Chunk, InPath, Field);
+
 		// do this before appending.
-		LowerVerticesNearPath(Chunk, InPath, Vertices);
+		LowerVerticesNearPath(Chunk, Field, Vertices);
 
-		TArray<FVector3f> Vertices2, Tangents2, Normals2;
-		TArray<uint32> Triangles2;
-		TArray<FVector2DHalf> UVs2;
-		GetPathStreamSetComponents(Chunk, InPath, Vertices2, Tangents2, Normals2, Triangles2, UVs2);
+		TArray<FVector3f>& Vertices2 = Scratch.Vertices2;
+		TArray<FVector3f>& Tangents2 = Scratch.Tangents2;
+		TArray<FVector3f>& Normals2 = Scratch.Normals2;
+		TArray<uint32>& Triangles2 = Scratch.Triangles2;
+		TArray<FVector2DHalf>& UVs2 = Scratch.UVs2;
+		GetPathStreamSetComponents(Chunk, Field, Vertices2, Tangents2, Normals2, Triangles2, UVs2);
 
 		//append it to original ones.
 		int32 BaseIndex = Vertices.Num();
@@ -60,6 +226,106 @@ void FChunkBuilder::GetStreamSet(const FIntPoint& Chunk, const TArray<FVector>&
 		UVs.Append(UVs2);
 	}
 
+	BuildStreamSet(Vertices, Tangents, Normals, Triangles, UVs, OutStreamSet, BaseTriangles.Get());
+
+	if (OutMesh)
+	{
+		OutMesh->LOD = LOD;
+		OutMesh->Vertices = Vertices;
+		OutMesh->Tangents = Tangents;
+		OutMesh->Normals = Normals;
+		OutMesh->UVs = UVs;
+		OutMesh->Triangles = Triangles;
+	}
+
+	const int32 IndexNum = BaseTriangles->Num() + Triangles.Num();
+	const int32 MeshBytes = GetMeshBytes(Vertices.Num(), IndexNum, UseCompactLayout);
+
+	// full detail chunks only, that's what ChunkRadius pays for.
+	if (LOD <= 0)
+	{
+		LastChunkBytes = MeshBytes;
+		LastChunkSavedBytes = GetMeshBytes(Vertices.Num(), IndexNum, false) - MeshBytes;
+	}
+	return MeshBytes;
+}
+
+int32 FChunkBuilder::GetStreamSet(const FChunkMeshView& Mesh, RealtimeMesh::FRealtimeMeshStreamSet& OutStreamSet)
+{
+	FTrianglesPtr BaseTriangles = GetBaseTriangles(Mesh.LOD);
+	BuildStreamSet(Mesh.Vertices, Mesh.Tangents, Mesh.Normals, Mesh.Triangles, Mesh.UVs, OutStreamSet, BaseTriangles.Get());
+	return GetMeshBytes(Mesh.Vertices.Num(), BaseTriangles->Num() + Mesh.Triangles.Num(), UseCompactLayout);
+}
+
+// thread safe. grid triangles (+ skirts) of one LOD, made on first use. every chunk on that LOD has the same ones.
+FTrianglesPtr FChunkBuilder::GetBaseTriangles(const int32& LOD)
+{
+	FScopeLock Lock(&BaseTrianglesMutex);
+	const FTrianglesPtr* Found = BaseTriangles.Find(LOD);
+	if (Found) return *Found;
+
+	const int32 VertexCount = GetLODVertexCount(LOD);
+	TSharedPtr<TArray<uint32>, ESPMode::ThreadSafe> Triangles = MakeShared<TArray<uint32>, ESPMode::ThreadSafe>();
+	GetTriangles(VertexCount, *Triangles);
+	if (MaxLOD > 0) AddSkirtTriangles(VertexCount, *Triangles);
+
+	BaseTriangles.Add(LOD, Triangles);
+	return Triangles;
+}
+
+// grid starts at the corner of chunk (Center - HorizonChunks). cells line up with chunk borders,
+// so the hole is exactly the chunks within HoleRadius. whole thing sits HorizonDrop under the terrain.
+void FChunkBuilder::GetHorizonStreamSet(const FIntPoint& Center, const int32& HoleRadius, RealtimeMesh::FRealtimeMeshStreamSet& OutStreamSet)
+{
+	const int32 CellNum = (HorizonChunks * 2 + 1) * HorizonCellsPerChunk;
+	const int32 VertexCount = CellNum + 1;
+	const float Spacing = ChunkLength / HorizonCellsPerChunk;
+	const FVector2D Origin = FVector2D(Center - FIntPoint(HorizonChunks)) * ChunkLength;
+	float UVScale = Spacing / TextureSize;
+
+	TArray<float> Heights;
+	GetHeights(Origin, Spacing, FIntPoint(0, 0), FIntPoint(VertexCount, VertexCount), Heights);
+
+	TArray<FVector3f> Vertices, Tangents, Normals;
+	TArray<uint32> Triangles;
+	TArray<FVector2DHalf> UVs;
+	Vertices.Reserve(VertexCount * VertexCount);
+	Tangents.Reserve(VertexCount * VertexCount);
+	Normals.Reserve(VertexCount * VertexCount);
+	UVs.Reserve(VertexCount * VertexCount);
+
+	for (int32 iY = 0; iY < VertexCount; iY++)
+	{
+		for (int32 iX = 0; iX < VertexCount; iX++)
+		{
+			Vertices.Add(FVector3f(iX * Spacing, iY * Spacing, Heights[iY * VertexCount + iX] - HorizonDrop));
+
+			// central differences, one sided on the outer rim.
+			int32 Left = FMath::Max(iX - 1, 0), Right = FMath::Min(iX + 1, VertexCount - 1);
+			int32 Up = FMath::Max(iY - 1, 0), Down = FMath::Min(iY + 1, VertexCount - 1);
+			float SlopeX = (Heights[iY * VertexCount + Right] - Heights[iY * VertexCount + Left]) / ((Right - Left) * Spacing);
+			float SlopeY = (Heights[Down * VertexCount + iX] - Heights[Up * VertexCount + iX]) / ((Down - Up) * Spacing);
+
+			Normals.Add(FVector3f(-SlopeX, -SlopeY, 1.0f).GetSafeNormal());
+			Tangents.Add(FVector3f(1.0f, 0.0f, SlopeX).GetSafeNormal());
+			UVs.Add(FVector2DHalf(iX * UVScale, iY * UVScale));
+		}
+	}
+
+	for (int32 iY = 0; iY < CellNum; iY++)
+	{
+		for (int32 iX = 0; iX < CellNum; iX++)
+		{
+			FIntPoint Chunk = FIntPoint(iX / HorizonCellsPerChunk, iY / HorizonCellsPerChunk) - FIntPoint(HorizonChunks);
+			if (FMath::Max(FMath::Abs(Chunk.X), FMath::Abs(Chunk.Y)) <= HoleRadius) continue;
+
+			// same winding as GetTriangles.
+			uint32 CurrentVertex = iX + iY * VertexCount;
+			Triangles.Append({ CurrentVertex, CurrentVertex + VertexCount, CurrentVertex + 1 });
+			Triangles.Append({ CurrentVertex + VertexCount, CurrentVertex + VertexCount + 1, CurrentVertex + 1 });
+		}
+	}
+
 	BuildStreamSet(Vertices, Tangents, Normals, Triangles, UVs, OutStreamSet);
 }
 
@@ -88,48 +354,273 @@ float FChunkBuilder::GetHeight( const FVector2D& Location )
 	return height;
 }
 
+// batch GetHeight on a grid. sample positions are made exactly like GetVertices does.
+void FChunkBuilder::GetHeights(const FVector2D& Origin, const float& Spacing, const FIntPoint& StartIndex, const FIntPoint& Count, TArray<float>& OutHeights)
+{
+	TArray<FVector2D>& Locations = FChunkScratch::Get().Locations;
+	Locations.Reset();
+	Locations.SetNumUninitialized(Count.X * Count.Y);
+
+	int32 Index = 0;
+	for (int32 iY = StartIndex.Y; iY < StartIndex.Y + Count.Y; iY++)
+	{
+		for (int32 iX = StartIndex.X; iX < StartIndex.X + Count.X; iX++)
+		{
+			// float first, same as FVector3f(iX, iY, 0) * VertexSpacing
+			Locations[Index++] = FVector2D(float(iX) * Spacing, float(iY) * Spacing) + Origin;
+		}
+	}
+
+	GetHeights(Locations, OutHeights);
+}
+
+// batch GetHeight. 4 samples at a time with SIMD, per noise layer.
+void FChunkBuilder::GetHeights(const TArray<FVector2D>& Locations, TArray<float>& OutHeights)
+{
+	const int32 Num = Locations.Num();
+	OutHeights.Reset();
+	OutHeights.SetNumZeroed(Num);
+
+	if (ShouldGenerateHeight == false || this->NoiseLayers.Num() <= 0)
+	{ return; }
+
+	if (!UseBatchHeight)
+	{
+		for (int32 i = 0; i < Num; i++) OutHeights[i] = GetHeight(Locations[i]);
+		return;
+	}
+
+	// pad to SIMD width. padded lanes are computed and thrown away.
+	const int32 PaddedNum = Align(Num, 4);
+	FChunkScratch& Scratch = FChunkScratch::Get();
+	TArray<float>& Xs = Scratch.Xs;
+	TArray<float>& Ys = Scratch.Ys;
+	TArray<float>& Heights = Scratch.Heights;
+	Xs.Reset();
+	Ys.Reset();
+	Heights.Reset();
+	Xs.SetNumZeroed(PaddedNum);
+	Ys.SetNumZeroed(PaddedNum);
+	Heights.SetNumZeroed(PaddedNum);
+
+	for (int32 i = 0; i < NoiseLayers.Num(); i++)
+	{
+		float Frequency = NoiseLayers[i].Frequency;
+		if (FMath::IsNearlyZero(Frequency))
+		{ continue; }
+		float NoiseScale = 1.0f / Frequency;
+		float Amplitude = NoiseLayers[i].Amplitude;
+		float Offset = NoiseLayers[i].Offset;
+
+		// scale in double then drop to float, same as GetHeight -> PerlinNoise2D.
+		for (int32 k = 0; k < Num; k++)
+		{
+			FVector2D NoisePos = Locations[k] * NoiseScale + Offset;
+			Xs[k] = float(NoisePos.X);
+			Ys[k] = float(NoisePos.Y);
+		}
+
+		ChunkNoise::AddPerlinNoise2D(Xs.GetData(), Ys.GetData(), PaddedNum, Amplitude, Heights.GetData());
+	}
+
+	FMemory::Memcpy(OutHeights.GetData(), Heights.GetData(), Num * sizeof(float));
+}
+
 
 // ---- private below ------
 
-void FChunkBuilder::GetStreamSetComponents(const FIntPoint& Chunk, TArray<FVector3f>& Vertices, TArray<FVector3f>& Tangents, TArray<FVector3f>& Normals, TArray<uint32>& Triangles, TArray<FVector2DHalf>& UVs)
+// compares batch heights with scalar GetHeight. returns false if SIMD path can't be trusted.
+bool FChunkBuilder::CheckBatchHeight()
+{
+	if (ShouldGenerateHeight == false || this->NoiseLayers.Num() <= 0)
+	{ return true; }
+
+	// a few chunks worth of samples, including negative coordinates and odd offsets.
+	TArray<FVector2D> Locations;
+	for (int32 j = -8; j < 8; j++)
+		for (int32 i = -8; i < 8; i++)
+		{
+			Locations.Add(FVector2D(i * ChunkLength * 0.37, j * ChunkLength * 0.53) + FVector2D(i * 13.7, j * 71.3));
+		}
+
+	TArray<float> Heights;
+	UseBatchHeight = true;
+	GetHeights(Locations, Heights);
+
+	float MaxError = 0.f;
+	for (int32 i = 0; i < Locations.Num(); i++)
+	{
+		MaxError = FMath::Max(MaxError, FMath::Abs(Heights[i] - GetHeight(Locations[i])));
+	}
+
+	if (MaxError > BatchHeightTolerance)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Batch height error %f too big. using scalar GetHeight"), MaxError);
+		return false;
+	}
+	return true;
+}
+
+void FChunkBuilder::GetStreamSetComponents(const FIntPoint& Chunk, TArray<FVector3f>& Vertices, TArray<FVector3f>& Tangents, TArray<FVector3f>& Normals, TArray<FVector2DHalf>& UVs)
 {
 	// scale UV based on vetex spacing
 	float UVScale = VertexSpacing / TextureSize;
 
-	Vertices.Empty();
-	Tangents.Empty();
-	Normals.Empty();
-	Triangles.Empty();
-	UVs.Empty();
+	Vertices.Reset();
+	Tangents.Reset();
+	Normals.Reset();
+	UVs.Reset();
+
+	// heights come from shared tile cache. PathFinder reads the same tile.
+	FHeightTilePtr Tile = pLM->GetHeightTile(Chunk);
 
-	GetVertices(Chunk, 0, VerticesPerChunk, VertexSpacing,
+	GetVertices(*Tile, 0, VerticesPerChunk, VertexSpacing,
 		Vertices); // this line for OutParam.
 
 	GetUVs(Chunk, 0, VerticesPerChunk, UVScale,
 		UVs);
 
-	GetTriangles(VerticesPerChunk,
-		Triangles);
+	// straight from the tile heights. continuous along chunks.
+	TArray<int32>& Coords = FChunkScratch::Get().Coords;
+	GetLODCoords(0, Coords);
+	GetTangents(*Tile, Coords,
+		Tangents, Normals);
 
-	Tangents.SetNum(Vertices.Num());
-	Normals.SetNum(Vertices.Num());
+}
 
-	// Big data for uv and normal continue on different chunks
-	TArray<FVector3f> BigVertices;
-	TArray<uint32> BigTriangles;
+// grid of every (1 << LOD)th vertex. normals still come from the full res tile, so shading matches LOD 0.
+void FChunkBuilder::GetLODStreamSetComponents(const FIntPoint& Chunk, const int32& LOD, TArray<FVector3f>& Vertices, TArray<FVector3f>& Tangents, TArray<FVector3f>& Normals, TArray<FVector2DHalf>& UVs)
+{
+	float UVScale = VertexSpacing / TextureSize;
 
-	GetBigVertices(Chunk, Vertices,
-		BigVertices);
-	GetTriangles(VerticesPerChunk + 2,
-		BigTriangles);
+	Vertices.Reset();
+	Tangents.Reset();
+	Normals.Reset();
+	UVs.Reset();
 
-	// Normals and Tangents made out of Big datas.
-	GetTangents(VerticesPerChunk, BigTriangles, BigVertices,
-		Tangents, Normals);
+	FHeightTilePtr Tile = pLM->GetHeightTile(Chunk);
+
+	TArray<int32>& Coords = FChunkScratch::Get().Coords;
+	GetLODCoords(LOD, Coords);
+	const int32 VertexCount = Coords.Num();
+
+	Vertices.Reserve(VertexCount * VertexCount);
+	UVs.Reserve(VertexCount * VertexCount);
+
+	for (int32 iY : Coords)
+	{
+		for (int32 iX : Coords)
+		{
+			FVector3f Vertex = FVector3f(iX, iY, 0.0f) * VertexSpacing;
+			if (this->ShouldGenerateHeight)
+			{ Vertex.Z = Tile->GetVertexHeight(FIntPoint(iX, iY)); }
+			Vertices.Add(Vertex);
+
+			// same mapping as GetUVs on LOD 0.
+			UVs.Add(FVector2DHalf(((VerticesPerChunk - 1) + iX) * UVScale, ((VerticesPerChunk - 1) + iY) * UVScale));
+		}
+	}
+
+	GetTangents(*Tile, Coords, Tangents, Normals);
+}
+
+// local vertex coords on one side. last one is always the chunk edge, even if the stride doesn't fit.
+void FChunkBuilder::GetLODCoords(const int32& LOD, TArray<int32>& OutCoords)
+{
+	OutCoords.Reset();
+
+	const int32 Stride = 1 << FMath::Clamp(LOD, 0, 8);
+	for (int32 i = 0; i < VerticesPerChunk - 1; i += Stride) OutCoords.Add(i);
+	OutCoords.Add(VerticesPerChunk - 1);
+}
+
+// same as GetLODCoords(LOD).Num()
+int32 FChunkBuilder::GetLODVertexCount(const int32& LOD)
+{
+	const int32 Stride = 1 << FMath::Clamp(LOD, 0, 8);
+	return FMath::DivideAndRoundUp(VerticesPerChunk - 1, Stride) + 1;
+}
+
+// border indices as one loop. -Y row, +X column, +Y row, -X column.
+void FChunkBuilder::GetBorder(const int32& VertexCount, TArray<int32>& OutBorder)
+{
+	OutBorder.Reset();
+	for (int32 i = 0; i < VertexCount; i++) OutBorder.Add(i);
+	for (int32 i = 1; i < VertexCount; i++) OutBorder.Add(i * VertexCount + VertexCount - 1);
+	for (int32 i = VertexCount - 2; i >= 0; i--) OutBorder.Add((VertexCount - 1) * VertexCount + i);
+	for (int32 i = VertexCount - 2; i >= 1; i--) OutBorder.Add(i * VertexCount);
+}
+
+// curtain hanging SkirtDepth down from the chunk border. both windings, so it's seen from either side.
+// skirt vertices go right after the grid. triangles are in AddSkirtTriangles.
+void FChunkBuilder::AddSkirts(const int32& VertexCount, TArray<FVector3f>& Vertices, TArray<FVector3f>& Tangents, TArray<FVector3f>& Normals, TArray<FVector2DHalf>& UVs)
+{
+	if (VertexCount < 2) return;
+
+	TArray<int32>& Border = FChunkScratch::Get().Border;
+	GetBorder(VertexCount, Border);
+
+	for (int32 Index : Border)
+	{
+		Vertices.Add(Vertices[Index] - FVector3f(0.0f, 0.0f, SkirtDepth));
+		Tangents.Add(Tangents[Index]);
+		Normals.Add(Normals[Index]);
+		UVs.Add(UVs[Index]);
+	}
+}
+
+// appends skirt triangles for a VertexCount^2 grid + its skirt vertices.
+void FChunkBuilder::AddSkirtTriangles(const int32& VertexCount, TArray<uint32>& Triangles)
+{
+	if (VertexCount < 2) return;
 
+	TArray<int32> Border;
+	GetBorder(VertexCount, Border);
+
+	const int32 BaseIndex = VertexCount * VertexCount;
+	for (int32 i = 0; i < Border.Num(); i++)
+	{
+		int32 Next = (i + 1) % Border.Num();
+		uint32 TopA = Border[i], TopB = Border[Next];
+		uint32 BottomA = BaseIndex + i, BottomB = BaseIndex + Next;
+
+		Triangles.Append({ TopA, BottomA, TopB, BottomA, BottomB, TopB });
+		Triangles.Append({ TopA, TopB, BottomA, BottomA, TopB, BottomB });
+	}
 }
 
-void FChunkBuilder::GetPathStreamSetComponents(const FIntPoint& Chunk, const TArray<FVector>& InPath, TArray<FVector3f>& Vertices, TArray<FVector3f>& Tangents, TArray<FVector3f>& Normals, TArray<uint32>& Triangles, TArray<FVector2DHalf>& UVs)
+// field on the detail grid, over where the road layer can be + a margin, so roads just outside still count.
+void FChunkBuilder::MakeRoadField(const FIntPoint& Chunk, const TArray<FVector>& InPath, FRoadField& OutField)
+{
+	OutField.Reset();
+
+	// same box as GetPathStreamSetComponents. chunk + one ring of grids.
+	const int32& Rad = this->CoverageRad;
+	const int32 CellNum = VerticesPerChunk - 1;
+	const FIntPoint BoxMin = Chunk * CellNum - FIntPoint(1);
+	const FIntPoint BoxMax = (Chunk + FIntPoint(1)) * CellNum;
+
+	FIntPoint NeededMin = FIntPoint(MAX_int32), NeededMax = FIntPoint(MIN_int32);
+	for (auto& Elem : InPath)
+	{
+		FIntPoint Grid = GetGlobalGrid(Elem);
+		NeededMin = FIntPoint(FMath::Min(NeededMin.X, Grid.X - Rad), FMath::Min(NeededMin.Y, Grid.Y - Rad));
+		NeededMax = FIntPoint(FMath::Max(NeededMax.X, Grid.X + Rad), FMath::Max(NeededMax.Y, Grid.Y + Rad));
+	}
+	NeededMin = FIntPoint(FMath::Max(NeededMin.X, BoxMin.X), FMath::Max(NeededMin.Y, BoxMin.Y));
+	NeededMax = FIntPoint(FMath::Min(NeededMax.X, BoxMax.X), FMath::Min(NeededMax.Y, BoxMax.Y));
+	if (NeededMin.X > NeededMax.X || NeededMin.Y > NeededMax.Y) return;
+
+	NeededMin -= FIntPoint(Rad + 1);
+	NeededMax += FIntPoint(Rad + 1);
+
+	// roads are stepped finer than this. anything longer is a jump between two roads.
+	const float MaxGap = VertexSpacing * 2.0f;
+	OutField.Build(InPath, NeededMin * DetailCount, (NeededMax - NeededMin + FIntPoint(1)) * DetailCount + FIntPoint(1),
+		VertexSpacing / DetailCount, MaxGap);
+}
+
+void FChunkBuilder::GetPathStreamSetComponents(const FIntPoint& Chunk, const FRoadField& Field, TArray<FVector3f>& Vertices, TArray<FVector3f>& Tangents, TArray<FVector3f>& Normals, TArray<uint32>& Triangles, TArray<FVector2DHalf>& UVs)
 {
 	if (int32(VertexSpacing / 100) % DetailCount != 0) // does not fit. (meter)
 	{
@@ -137,268 +628,241 @@ void FChunkBuilder::GetPathStreamSetComponents(const FIntPoint& Chunk, const TAr
 		return;
 	}
 
-	Vertices.Empty();
-	Tangents.Empty();
-	Normals.Empty();
-	Triangles.Empty();
-	UVs.Empty();
+	Vertices.Reset();
+	Tangents.Reset();
+	Normals.Reset();
+	Triangles.Reset();
+	UVs.Reset();
 
-	// x, y == local.
-	TArray<FVector> Path;
-	for (int32 i = 0; i < InPath.Num(); i++) // sample more points.
-	{
-		Path.Add(InPath[i]);
-		if (InPath.Num() > i + 1 && FVector::DistSquared2D(InPath[i], InPath[i + 1]) <= FMath::Square(VertexSpacing))
-			Path.Add((InPath[i] + InPath[i + 1]) / 2);
-	}
-	if (!InPath.IsEmpty()) Path.Add(InPath.Last());
+	if (Field.IsEmpty()) return;
+
+	FChunkScratch& Scratch = FChunkScratch::Get();
+
+	// resampled road. global.
+	const TArray<FVector>& Path = Field.Points;
 
-	// init. find GridNeeded to be made, by checking GridWithPaths.
-	TMultiMap<FIntPoint, int32> GridWithPath;
-	TSet<FIntPoint> GridNeeded;
+	// everything below is on dense arrays over bounding boxes, row by row.
+
+	// big grids (VertexSpacing) the detail layer can touch. chunk + one ring around it.
 	const int32& Rad = this->CoverageRad;
+	const int32 CellNum = VerticesPerChunk - 1;
+	const FIntPoint BoxMin = Chunk * CellNum - FIntPoint(1);
+	const int32 BoxNum = CellNum + 2;
+
+	TArray<uint8>& GridNeeded = Scratch.GridNeeded;
+	GridNeeded.Reset();
+	GridNeeded.SetNumZeroed(BoxNum * BoxNum);
+	FIntPoint NeededMin = FIntPoint(MAX_int32), NeededMax = FIntPoint(MIN_int32);
+
 	for (int32 k = 0; k < Path.Num(); k++)
 	{
 		FIntPoint GlobalGrid = GetGlobalGrid(Path[k]);
-		GridWithPath.Add(GlobalGrid, k);
 
 		for (int32 j = -Rad; j <= Rad; j++)
 		{
 			for (int32 i = -Rad; i <= Rad; i++)
 			{
-				FIntPoint Needed = FIntPoint(i, j) + GlobalGrid;
-				GridNeeded.Add(Needed); // add all. even if out of chunk. filter later.
-			}
-		}
-	}
-
-	TSet<FIntPoint> RemoveSet;
-	// filter GridNeeded. only 
-	for (auto& Grid : GridNeeded)
-	{
-		if (GetChunk(Grid) == Chunk) continue;
+				FIntPoint Needed = GlobalGrid + FIntPoint(i, j);
+				FIntPoint Local = Needed - BoxMin;
+				if (Local.X < 0 || Local.Y < 0 || Local.X >= BoxNum || Local.Y >= BoxNum) continue;
 
-		bool IsNearChunk = false;
-		for (int32 j = -1; j <= 1; j++)
-			for (int32 i = -1; i <= 1; i++)
-			{
-				FIntPoint Target = Grid + FIntPoint(j, i);
-				if (GetChunk(Target) == Chunk)
-				{
-					IsNearChunk = true;
-					break;
-				}
+				GridNeeded[Local.Y * BoxNum + Local.X] = 1;
+				NeededMin = FIntPoint(FMath::Min(NeededMin.X, Needed.X), FMath::Min(NeededMin.Y, Needed.Y));
+				NeededMax = FIntPoint(FMath::Max(NeededMax.X, Needed.X), FMath::Max(NeededMax.Y, Needed.Y));
 			}
-
-		if (!IsNearChunk) RemoveSet.Add(Grid);
+		}
 	}
-
-	for (auto& Remover : RemoveSet) GridNeeded.Remove(Remover);
+	if (NeededMin.X > NeededMax.X) return; // path doesn't come near.
 
 
 	float DetailSpacing = VertexSpacing / DetailCount;
 	float UVScale = VertexSpacing / TextureSize;
 	UVScale /= DetailCount; // same size with original chunk.
 
-	// Global FIntPoint, Index for Verts. float for heights.
-	TMap<FIntPoint, TPair<int32, float>> DetailNeeded;
-	for (auto& GlobalGrid : GridNeeded)
+	// detail vertices (DetailSpacing) of the needed grids. one grid owns DetailCount + 1 per side, shared edges.
+	const FIntPoint DetailMin = NeededMin * DetailCount;
+	const FIntPoint DetailNum = (NeededMax - NeededMin + FIntPoint(1)) * DetailCount + FIntPoint(1);
+	const int32 DetailTotal = DetailNum.X * DetailNum.Y;
+
+	TArray<uint8>& DetailNeeded = Scratch.DetailNeeded;
+	DetailNeeded.Reset();
+	DetailNeeded.SetNumZeroed(DetailTotal);
+	for (int32 gY = NeededMin.Y; gY <= NeededMax.Y; gY++)
 	{
-		// add vertices needed.
-		for (int32 j = 0; j <= DetailCount; j++)
-			for (int32 i = 0; i <= DetailCount; i++)
-			{
-				FIntPoint DetailGrid = FIntPoint(i, j);
-				FIntPoint Offset = GlobalGrid * DetailCount;
-				DetailNeeded.Add(DetailGrid + Offset, TPair<int32, float>(-1, INFLOAT));
-				// global FIntPoint, but smaller vertexspacing. (DetailSpacing), Index = -1 by default.
-			}
+		for (int32 gX = NeededMin.X; gX <= NeededMax.X; gX++)
+		{
+			if (!GridNeeded[(gY - BoxMin.Y) * BoxNum + (gX - BoxMin.X)]) continue;
+
+			FIntPoint Offset = FIntPoint(gX, gY) * DetailCount - DetailMin;
+			for (int32 j = 0; j <= DetailCount; j++)
+				for (int32 i = 0; i <= DetailCount; i++)
+				{
+					DetailNeeded[(Offset.Y + j) * DetailNum.X + (Offset.X + i)] = 1;
+				}
+		}
 	}
 
-	// sort by (X,Y) small to big
-	auto Sorter = [](const FIntPoint& A, const FIntPoint& B)
+	// all detail heights in one batch, row by row.
+	TArray<FVector2D>& DetailLocations = Scratch.DetailLocations;
+	DetailLocations.Reset();
+	for (int32 dY = 0; dY < DetailNum.Y; dY++)
+	{
+		for (int32 dX = 0; dX < DetailNum.X; dX++)
 		{
-			if (A.Y < B.Y) return true;
-			else if (A.Y == B.Y)
-			{
-				return A.X < B.X;
-			}
-			else return false;
-		};
-
-	// sort it to get right index.
-	DetailNeeded.KeySort(Sorter);
+			if (!DetailNeeded[dY * DetailNum.X + dX]) continue;
+			FIntPoint SGlobalGrid = DetailMin + FIntPoint(dX, dY);
+			DetailLocations.Add(FVector2D(SGlobalGrid.X, SGlobalGrid.Y) * DetailSpacing);
+		}
+	}
+	TArray<float>& BatchHeights = Scratch.BatchHeights;
+	GetHeights(DetailLocations, BatchHeights);
+
+	// Global FIntPoint -> Index for Verts. -1 if not in this chunk. heights after road blending.
+	TArray<int32>& DetailIndices = Scratch.DetailIndices;
+	TArray<float>& DetailHeights = Scratch.DetailHeights;
+	DetailIndices.Reset();
+	DetailHeights.Reset();
+	DetailIndices.SetNumUninitialized(DetailTotal);
+	for (int32& Elem : DetailIndices) Elem = -1;
+	DetailHeights.SetNumZeroed(DetailTotal);
 	int32 Index = 0;
+	int32 HeightIndex = 0;
 
 	// Vertex Generation.
-	for (auto& Elem : DetailNeeded)
+	for (int32 dY = 0; dY < DetailNum.Y; dY++)
 	{
+		for (int32 dX = 0; dX < DetailNum.X; dX++)
+		{
+			const int32 Flat = dY * DetailNum.X + dX;
+			if (!DetailNeeded[Flat]) continue;
 
-		FIntPoint SGlobalGrid = Elem.Key;
-		float Height = GetHeight(FVector2D(SGlobalGrid.X, SGlobalGrid.Y) * DetailSpacing); // global value for height.
-
-		// --------------------Height Adjustment-------------------------- Start
-
-		// find all grid in radius that has path.
-		// get all indices in neighbor grids.
-		// find closest road point
-		// lerp
+			FIntPoint SGlobalGrid = DetailMin + FIntPoint(dX, dY);
+			float Height = BatchHeights[HeightIndex++]; // global value for height.
 
+			// --------------------Height Adjustment-------------------------- Start
 
-		// find all grid in radius that has path.
-		TArray<FIntPoint> NeighborWithPath;
-		for (int32 j = -Rad - 1; j <= Rad + 1; j++)
-		{
-			for (int32 i = -Rad - 1; i <= Rad + 1; i++)
+			// closest road point, straight from the field.
+			float Closest = INFLOAT;
+			float RoadHeight = 0.f;
+			if (Field.Contains(SGlobalGrid))
 			{
-				FIntPoint BigGlobalGrid; // Actual GlobalGrid(VertexSpacing) Grid that this DetailGrid is in.
-				BigGlobalGrid.X = FMath::FloorToInt32(SGlobalGrid.X * DetailSpacing / VertexSpacing);
-				BigGlobalGrid.Y = FMath::FloorToInt32(SGlobalGrid.Y * DetailSpacing / VertexSpacing);
-				FIntPoint Neighbor = FIntPoint(i, j) + BigGlobalGrid;
-
-				if (GridWithPath.Contains(Neighbor))	NeighborWithPath.Add(Neighbor);
+				Closest = Field.GetDistance(SGlobalGrid);
+				RoadHeight = Field.GetRoadHeight(SGlobalGrid);
 			}
-		}
-
-		// get all indices in neighbor grids.
-		TArray<int32> AllIndices;
-		for (auto& Neighbor : NeighborWithPath)
-		{
-			TArray<int32> Indices;
-			GridWithPath.MultiFind(Neighbor, Indices);
-			if (!Indices.IsEmpty()) AllIndices.Append(Indices);
-		}
 
-		// find closest road point
-		float Closest = INFLOAT;
-		float RoadHeight = 0.f;
-		for (auto& PathIndex : AllIndices)
-		{
-			FVector Point = Path[PathIndex];
-			FVector2D GlobalVec = FVector2D(SGlobalGrid.X, SGlobalGrid.Y) * DetailSpacing;
-			float Distance = FVector2D::DistSquared(FVector2D(Point.X, Point.Y), GlobalVec);
-
-			if (Distance <= Closest) Closest = Distance, RoadHeight = Point.Z;
-		}
-
-		// lerp
-		Closest = FMath::Sqrt(Closest);
-		float RoadHeightDist = 1500.f;
-		float OriginalHeightDist = 3000.f;
-
-		float Alpha = 1.0f - (Closest - RoadHeightDist) / (OriginalHeightDist - RoadHeightDist);
-		Alpha = FMath::Clamp(Alpha, 0.f, 1.f);
-		Height = FMath::Lerp(Height, RoadHeight, Alpha);
+			// lerp
+			float RoadHeightDist = 1500.f;
+			float OriginalHeightDist = 3000.f;
 
-		// --------------------Height Adjustment-------------------------- End
+			float Alpha = 1.0f - (Closest - RoadHeightDist) / (OriginalHeightDist - RoadHeightDist);
+			Alpha = FMath::Clamp(Alpha, 0.f, 1.f);
+			Height = FMath::Lerp(Height, RoadHeight, Alpha);
 
+			// --------------------Height Adjustment-------------------------- End
 
-		// put Height Value into DetailNeeded
-		TPair<int32, float>& IndexHeight = Elem.Value;
-		IndexHeight.Value = Height;
+			DetailHeights[Flat] = Height;
 
-		// figure out if it's okay to make this vertex.
-		if (IsGridInChunk(Chunk, SGlobalGrid, DetailCount))
-		{
-			IndexHeight.Key = Index++;
-			// set UVs.
-			FVector2DHalf UV;
-			FIntPoint SLocalGrid = SGlobalGrid - Chunk * (VerticesPerChunk-1) * DetailCount;
-			UV.X = SLocalGrid.X * UVScale;
-			UV.Y = SLocalGrid.Y * UVScale;
-
-			UVs.Add(UV);
+			// figure out if it's okay to make this vertex.
+			if (IsGridInChunk(Chunk, SGlobalGrid, DetailCount))
+			{
+				DetailIndices[Flat] = Index++;
+				// set UVs.
+				FVector2DHalf UV;
+				FIntPoint SLocalGrid = SGlobalGrid - Chunk * (VerticesPerChunk-1) * DetailCount;
+				UV.X = SLocalGrid.X * UVScale;
+				UV.Y = SLocalGrid.Y * UVScale;
+
+				UVs.Add(UV);
+			}
 		}
-
 	}
 
 
-	// height smoothing
-	TMap<FIntPoint, float> Heights;
-	const int32& HRad = this->CoverageRad;
-	for (auto& Elem : DetailNeeded)
+	// height smoothing. box average, only where the whole box is in the layer. (borders keep theirs)
+	// summed area tables, so every box is 4 reads whatever the radius. double, big sums lose float precision.
+	const int32& HRad = this->SmoothRadius;
+	const int32 SatRow = DetailNum.X + 1;
+	TArray<double>& HeightSat = Scratch.HeightSat;
+	TArray<int32>& CountSat = Scratch.CountSat;
+	HeightSat.Reset();
+	CountSat.Reset();
+	HeightSat.SetNumZeroed(SatRow * (DetailNum.Y + 1));
+	CountSat.SetNumZeroed(SatRow * (DetailNum.Y + 1));
+	for (int32 dY = 0; dY < DetailNum.Y; dY++)
 	{
-		FIntPoint Grid = Elem.Key;
-		int32 IndexNow = Elem.Value.Key;
-		float Height = Elem.Value.Value; // we'll change this.
-
-		TArray<float> TempHeights;
-		// get all indices in HRad*2+1 box radius
-		for (int32 j = -HRad; j <= HRad; j++)
-			for (int32 i = -HRad; i <= HRad; i++)
+		double RowSum = 0.0;
+		int32 RowCount = 0;
+		for (int32 dX = 0; dX < DetailNum.X; dX++)
+		{
+			const int32 Flat = dY * DetailNum.X + dX;
+			if (DetailNeeded[Flat])
 			{
-				FIntPoint Target = Grid + FIntPoint(i, j);
-				TPair<int32, float>* Found = DetailNeeded.Find(Target);
-				if (Found) TempHeights.Add((*Found).Value);
+				RowSum += DetailHeights[Flat];
+				RowCount++;
 			}
 
-		// if can't get every grid in HRad, use original height (borders)
-		if (TempHeights.Num() >= FMath::Square(HRad * 2 + 1))
-		{
-			float Sum = 0.f;
-			for (auto& Temp : TempHeights) Sum += Temp;
-			Height = Sum / TempHeights.Num();
+			HeightSat[(dY + 1) * SatRow + dX + 1] = HeightSat[dY * SatRow + dX + 1] + RowSum;
+			CountSat[(dY + 1) * SatRow + dX + 1] = CountSat[dY * SatRow + dX + 1] + RowCount;
 		}
-
-		Heights.Add(Grid, Height);
 	}
 
-	// Index = last one + 1 = Num.
-	Vertices.SetNum(Index);
-	for (auto& Elem : DetailNeeded)
+	const int32 FullCount = FMath::Square(HRad * 2 + 1);
+	Vertices.SetNum(Index); // Index = last one + 1 = Num.
+	for (int32 dY = 0; dY < DetailNum.Y; dY++)
 	{
-		FIntPoint Grid = Elem.Key;
-		int32 IndexNow = Elem.Value.Key;
-
-		float* FoundHeight = Heights.Find(Grid);
-		if (!FoundHeight)
+		for (int32 dX = 0; dX < DetailNum.X; dX++)
 		{
-			UE_LOG(LogTemp, Warning, TEXT("PathStreamSet Height Error!!!"));
-			continue;
-		}
+			const int32 Flat = dY * DetailNum.X + dX;
+			const int32 IndexNow = DetailIndices[Flat];
+			if (!DetailNeeded[Flat] || IndexNow < 0) continue;
 
-		float Height = *FoundHeight;
+			float Height = DetailHeights[Flat];
 
-		TSet<FIntPoint> OtherChunks;
-		GetPossibleChunks(Grid, DetailCount, OtherChunks);
-		OtherChunks.Remove(Chunk); // remove self.
+			// box corners in the table. box sticking out of the grid can't be full.
+			int32 X0 = dX - HRad, Y0 = dY - HRad, X1 = dX + HRad + 1, Y1 = dY + HRad + 1;
+			if (X0 >= 0 && Y0 >= 0 && X1 <= DetailNum.X && Y1 <= DetailNum.Y)
+			{
+				int32 Count = CountSat[Y1 * SatRow + X1] - CountSat[Y0 * SatRow + X1] - CountSat[Y1 * SatRow + X0] + CountSat[Y0 * SatRow + X0];
+				if (Count == FullCount)
+				{
+					double Sum = HeightSat[Y1 * SatRow + X1] - HeightSat[Y0 * SatRow + X1] - HeightSat[Y1 * SatRow + X0] + HeightSat[Y0 * SatRow + X0];
+					Height = float(Sum / FullCount);
+				}
+			}
 
-		FIntPoint LocalGrid = Grid - Chunk * (VerticesPerChunk - 1) * DetailCount;
-		// local space for vertex.
-		FVector3f Vertex = FVector3f(LocalGrid.X, LocalGrid.Y, 0.f) * DetailSpacing;
-		Vertex.Z = (*FoundHeight);	// set height value.
+			FIntPoint LocalGrid = DetailMin + FIntPoint(dX, dY) - Chunk * (VerticesPerChunk - 1) * DetailCount;
+			// local space for vertex.
+			FVector3f Vertex = FVector3f(LocalGrid.X, LocalGrid.Y, 0.f) * DetailSpacing;
+			Vertex.Z = Height;	// set height value.
 
-		if (IndexNow >= 0) Vertices[IndexNow] = Vertex;	// apply it to Vertices.
+			Vertices[IndexNow] = Vertex;	// apply it to Vertices.
+		}
 	}
 
 
 	// we have index, make triangles out of it.
-	for (auto& Elem : DetailNeeded)
-	{
-		FIntPoint GlobalGrid = Elem.Key;
-		int32 Index0 = Elem.Value.Key;
-		if (Index0 < 0) continue;
-
-		TPair<int32, float>* Index1, * Index2, * Index3; // square.
-		//	0	1
-		//	2	3
-		Index1 = DetailNeeded.Find(GlobalGrid + FIntPoint(1, 0));
-		Index2 = DetailNeeded.Find(GlobalGrid + FIntPoint(0, 1));
-		Index3 = DetailNeeded.Find(GlobalGrid + FIntPoint(1, 1));
+	auto GetDetailIndex = [&DetailNum, &DetailNeeded, &DetailIndices](const int32& X, const int32& Y) -> int32
+		{
+			if (X >= DetailNum.X || Y >= DetailNum.Y || !DetailNeeded[Y * DetailNum.X + X]) return -1;
+			return DetailIndices[Y * DetailNum.X + X];
+		};
 
-		// if not in map.
-		if (!Index1 || !Index2 || !Index3) continue;
+	for (int32 dY = 0; dY < DetailNum.Y; dY++)
+	{
+		for (int32 dX = 0; dX < DetailNum.X; dX++)
+		{
+			int32 Index0 = GetDetailIndex(dX, dY);
+			if (Index0 < 0) continue;
 
-		int32 I1 = (*Index1).Key;
-		int32 I2 = (*Index2).Key;
-		int32 I3 = (*Index3).Key;
+			//	0	1
+			//	2	3
+			int32 I1 = GetDetailIndex(dX + 1, dY);
+			int32 I2 = GetDetailIndex(dX, dY + 1);
+			int32 I3 = GetDetailIndex(dX + 1, dY + 1);
 
-		// if not in chunk.
-		if (I1 < 0 || I2 < 0 || I3 < 0) continue;
+			// if not in chunk, or not in layer.
+			if (I1 < 0 || I2 < 0 || I3 < 0) continue;
 
-		// if all three are in the map.
-		if (Index1 && Index2 && Index3)
-		{
 			// CounterClockWise.
 			Triangles.Add(Index0);
 			Triangles.Add(I2);
@@ -430,106 +894,102 @@ void FChunkBuilder::GetPathStreamSetComponents(const FIntPoint& Chunk, const TAr
 
 }
 
-void FChunkBuilder::BuildStreamSet(TArray<FVector3f>& Vertices, TArray<FVector3f>& Tangents, TArray<FVector3f>& Normals, TArray<uint32>& Triangles, TArray<FVector2DHalf>& UVs, RealtimeMesh::FRealtimeMeshStreamSet& OutStreamSet)
+// BaseTriangles (grid of the LOD, copied in) go first if given, then Triangles.
+void FChunkBuilder::BuildStreamSet(TConstArrayView<FVector3f> Vertices, TConstArrayView<FVector3f> Tangents, TConstArrayView<FVector3f> Normals, TConstArrayView<uint32> Triangles, TConstArrayView<FVector2DHalf> UVs, RealtimeMesh::FRealtimeMeshStreamSet& OutStreamSet,
+	const TArray<uint32>* BaseTriangles)
 {
 	// Datas into StreamSet
 	OutStreamSet.Empty();
-	RealtimeMesh::TRealtimeMeshBuilderLocal<uint32, FPackedNormal, FVector2DHalf, 1> Builder(OutStreamSet);
+
+	// 16 bit indices only if every vertex fits.
+	if (UseCompactLayout && IsCompact(Vertices.Num()))
+		BuildStreams<uint16>(Vertices, Tangents, Normals, Triangles, UVs, BaseTriangles, true, OutStreamSet);
+	else
+		BuildStreams<uint32>(Vertices, Tangents, Normals, Triangles, UVs, BaseTriangles, UseCompactLayout, OutStreamSet);
+}
+
+template<typename IndexType>
+void FChunkBuilder::BuildStreams(TConstArrayView<FVector3f> Vertices, TConstArrayView<FVector3f> Tangents, TConstArrayView<FVector3f> Normals, TConstArrayView<uint32> Triangles, TConstArrayView<FVector2DHalf> UVs,
+	const TArray<uint32>* BaseTriangles, const bool& Compact, RealtimeMesh::FRealtimeMeshStreamSet& OutStreamSet)
+{
+	RealtimeMesh::TRealtimeMeshBuilderLocal<IndexType, FPackedNormal, FVector2DHalf, 1> Builder(OutStreamSet);
 	Builder.EnableTangents();
 	Builder.EnableTexCoords();
-	Builder.EnableColors();
-	Builder.EnablePolyGroups();
+	// color is always white and there's one polygroup. compact skips both, section 0 still covers everything.
+	if (!Compact)
+	{
+		Builder.EnableColors();
+		Builder.EnablePolyGroups();
+	}
 
 	for (int32 i = 0; i < Vertices.Num(); i++)
 	{
-		Builder.AddVertex(Vertices[i])
-			.SetNormalAndTangent(Normals[i], Tangents[i])
-			.SetColor(FColor::White)
-			.SetTexCoord(UVs[i]);
+		auto Vertex = Builder.AddVertex(Vertices[i]);
+		Vertex.SetNormalAndTangent(Normals[i], Tangents[i]);
+		Vertex.SetTexCoord(UVs[i]);
+		if (!Compact) Vertex.SetColor(FColor::White);
 	}
 
-	for (int32 i = 0; i < Triangles.Num(); i += 6)
+	auto AddTriangles = [&Builder, &Compact](TConstArrayView<uint32> InTriangles)
 	{
-		Builder.AddTriangle(
-			Triangles[i],
-			Triangles[i + 1],
-			Triangles[i + 2],
-			0
-		);
-
-		Builder.AddTriangle(
-			Triangles[i + 3],
-			Triangles[i + 4],
-			Triangles[i + 5],
-			0
-		);
-	}
+		for (int32 i = 0; i < InTriangles.Num(); i += 3)
+		{
+			if (Compact) Builder.AddTriangle(IndexType(InTriangles[i]), IndexType(InTriangles[i + 1]), IndexType(InTriangles[i + 2]));
+			else Builder.AddTriangle(IndexType(InTriangles[i]), IndexType(InTriangles[i + 1]), IndexType(InTriangles[i + 2]), 0);
+		}
+	};
 
+	if (BaseTriangles) AddTriangles(*BaseTriangles);
+	AddTriangles(Triangles);
 }
 
-// do this before appending.
-void FChunkBuilder::LowerVerticesNearPath(const FIntPoint& Chunk, const TArray<FVector>& InPath, TArray<FVector3f>& Vertices)
+bool FChunkBuilder::IsCompact(const int32& VertexNum)
 {
-	TSet<FIntPoint> GridSet;
-	TSet<FIntPoint> VertexSet;
+	return VertexNum <= int32(MAX_uint16) + 1;
+}
 
-	const int32& Rad = this->CoverageRad;
-	for (auto& Elem : InPath)
-	{
-		FIntPoint Pivot = GetGlobalGrid(Elem);
-		for (int32 j = -Rad; j <= Rad; j++)
-			for (int32 i = -Rad; i <= Rad; i++)
-				GridSet.Add(Pivot + FIntPoint(i, j));
-	}
+// what the stream set holds in bytes. Compact -> the layout BuildStreamSet would pick.
+int32 FChunkBuilder::GetMeshBytes(const int32& VertexNum, const int32& IndexNum, const bool& Compact)
+{
+	const bool SmallIndex = Compact && IsCompact(VertexNum);
 
+	int32 VertexBytes = sizeof(FVector3f) + 2 * sizeof(FPackedNormal) + sizeof(FVector2DHalf);
+	if (!Compact) VertexBytes += sizeof(FColor);
 
-	for (auto& Elem : GridSet)
-	{
-		// 0 1
-		// 2 3
-		VertexSet.Add(Elem);
-		VertexSet.Add(Elem + FIntPoint(1, 0)); // 1
-		VertexSet.Add(Elem + FIntPoint(0, 1)); // 2
-		VertexSet.Add(Elem + FIntPoint(1, 1)); // 3
-	}
+	int32 IndexBytes = SmallIndex ? sizeof(uint16) : sizeof(uint32);
+	int32 PolyGroupBytes = Compact ? 0 : (IndexNum / 3) * sizeof(uint16);
 
+	return VertexNum * VertexBytes + IndexNum * IndexBytes + PolyGroupBytes;
+}
 
-	// filter vertices on edge of coverage.
-	TSet<FIntPoint> ToRemove;
-	for (auto& Elem : VertexSet)
-	{
-		FIntPoint Global = Elem;
-		if (!GridSet.Contains(Global)
-			|| !GridSet.Contains(Global + FIntPoint(-1, 0))
-			|| !GridSet.Contains(Global + FIntPoint(0, -1))
-			|| !GridSet.Contains(Global + FIntPoint(-1, -1)))
-		{
-			ToRemove.Add(Elem);
-		}
-	}
-	// filter.
-	for (auto& Remover : ToRemove) VertexSet.Remove(Remover);
+// do this before appending. pushes base chunk under the road layer, below both terrain & road.
+void FChunkBuilder::LowerVerticesNearPath(const FIntPoint& Chunk, const FRoadField& Field, TArray<FVector3f>& Vertices)
+{
+	if (Field.IsEmpty()) return;
 
+	// road layer has every grid within CoverageRad of a road point. one less than that is always under it.
+	const float LowerDist = (CoverageRad - 1) * VertexSpacing;
+	const float CarveDepth = 1000.f;
+	if (LowerDist < 0.f) return;
 
-	for (auto& Elem : VertexSet)
+	for (int32 iY = 0; iY < VerticesPerChunk; iY++)
 	{
-		FIntPoint Local = Elem - Chunk * (VerticesPerChunk - 1);
-		if (IsIndexInChunk(Local))
+		for (int32 iX = 0; iX < VerticesPerChunk; iX++)
 		{
-			int32 Index = GetIndex(Local);
-			Vertices[Index].Z -= 1000.f;
+			FIntPoint Grid = (Chunk * (VerticesPerChunk - 1) + FIntPoint(iX, iY)) * DetailCount;
+			if (!Field.IsNearRoad(Grid, LowerDist)) continue;
+
+			float& Height = Vertices[GetIndex(FIntPoint(iX, iY))].Z;
+			Height = FMath::Min(Height, Field.GetRoadHeight(Grid)) - CarveDepth;
 		}
 	}
-
 }
 
-// returns Vertices for Streamset.
-void FChunkBuilder::GetVertices(const FIntPoint& Chunk, const int32 & StartIndex, const int32 & EndIndex, const int32& VertexSpace, TArray<FVector3f>& OutVertices)
+// returns Vertices for Streamset. heights from tile.
+void FChunkBuilder::GetVertices(const FHeightTile& Tile, const int32 & StartIndex, const int32 & EndIndex, const int32& VertexSpace, TArray<FVector3f>& OutVertices)
 {
 
-	OutVertices.Empty();
-
-	FVector2D Offset = FVector2D( Chunk.X , Chunk.Y ) * ChunkLength; 		// ChunkLength should always be same.
+	OutVertices.Reset(FMath::Square(EndIndex - StartIndex));
 	
 	for( int32 iY = StartIndex; iY < EndIndex; iY++ )
 	{
@@ -537,7 +997,7 @@ void FChunkBuilder::GetVertices(const FIntPoint& Chunk, const int32 & StartIndex
 		{
 			FVector3f Vertex = FVector3f(iX, iY, 0.0f) * VertexSpace; 		// VertexSpacing & VertexCount may vary later. (LoD)
 			if( this->ShouldGenerateHeight )
-			{ Vertex.Z = GetHeight( FVector2D( Vertex.X, Vertex.Y ) +  Offset ); }
+			{ Vertex.Z = Tile.GetVertexHeight(FIntPoint(iX, iY)); }
 			OutVertices.Add( Vertex );
 		}
 	}
@@ -549,7 +1009,7 @@ void FChunkBuilder::GetVertices(const FIntPoint& Chunk, const int32 & StartIndex
 void FChunkBuilder::GetUVs(const FIntPoint& Chunk, const int32& StartIndex, const int32& EndIndex, const float& UVscale, TArray<FVector2DHalf>& OutUVs)
 {
 	
-	OutUVs.Empty();
+	OutUVs.Reset();
 
 	int32 VertexCount = EndIndex - StartIndex;
 
@@ -595,38 +1055,6 @@ void FChunkBuilder::GetTriangles(const int32& VertexCount, TArray<uint32>& OutTr
 	return;
 }
 
-// this returns one vertex bigger square for normal calculation.
-void FChunkBuilder::GetBigVertices(const FIntPoint& Chunk, const TArray<FVector3f>& SmallVertices, TArray<FVector3f>& OutVertices)
-{
-	OutVertices.Empty();
-	FVector2D Offset = FVector2D(Chunk.X, Chunk.Y) * ChunkLength;
-
-	for (int32 i = -1; i < VerticesPerChunk + 1; i++)
-	{
-		for (int32 j = -1; j < VerticesPerChunk + 1; j++)
-		{
-			int32 Index = GetIndex(FIntPoint(j, i));
-
-			if (IsIndexInChunk(FIntPoint(j, i)))	// if it's in small vertices, just copy.
-			{
-				OutVertices.Add(SmallVertices[Index]);
-			}
-			else									// if it's not in small vertices, make one.
-			{
-				FVector3f Vertex = FVector3f(j, i, 0.0f) * VertexSpacing;
-				if (this->ShouldGenerateHeight)
-				{
-					Vertex.Z = GetHeight(FVector2D(Vertex.X, Vertex.Y) + Offset);
-				}
-				OutVertices.Add(Vertex);
-			}
-
-
-		} // for j
-	} // for i
-
-}
-
 void FChunkBuilder::MakeSquare(const int32& Index, const int32& CurrentVertex, const int32& VertexCount, TArray<uint32>& OutTriangles, bool Invert)
 {
 	if (Invert)
@@ -653,71 +1081,29 @@ void FChunkBuilder::MakeSquare(const int32& Index, const int32& CurrentVertex, c
 	return;
 }
 
-// returns Small Tangents and Normals that are continuous along chunks.
-void FChunkBuilder::GetTangents( const int32& VertexCount, const TArray<uint32>& BigTriangles, const TArray<FVector3f>& BigVertices, TArray<FVector3f>& OutTangents, TArray<FVector3f>& OutNormals )
+// central differences on the tile, full res, for every (Coords[i], Coords[j]) vertex.
+// tile has one vertex border, so chunk edges come out the same as on the neighbor.
+void FChunkBuilder::GetTangents(const FHeightTile& Tile, const TArray<int32>& Coords, TArray<FVector3f>& OutTangents, TArray<FVector3f>& OutNormals)
 {
+	OutTangents.Reset(Coords.Num() * Coords.Num());
+	OutNormals.Reset(Coords.Num() * Coords.Num());
 
-	int32 RowLength = VertexCount + 2;
-
-	RealtimeMeshAlgo::GenerateTangents(
-		TConstArrayView<uint32>( BigTriangles ),
-		BigVertices,
-		nullptr, // UV Getter. We made uv.
-		[&OutNormals, &OutTangents, &RowLength](int index, FVector3f Tangent, FVector3f Normal) -> void
-			{
-			// RowLength == ColumnLength
-			int iY = index / RowLength;
-			int iX = index % RowLength;
-
-			// initial index array (ex) RowLength = 4
-			/* 
-			0 	1 	2 	3
-			4 	5 	6 	7
-			8 	9 	10	11
-			12 	13 	14 	15
-			*/
-
-			if( iY <= 0 || iY >= RowLength - 1  	// ignore first and last Row
-				||
-				iX <= 0 || iX >= RowLength - 1 ) 	// ignore first and last Column
+	for (int32 iY : Coords)
+	{
+		for (int32 iX : Coords)
+		{
+			float Left = 0.0f, Right = 0.0f, Up = 0.0f, Down = 0.0f;
+			if (this->ShouldGenerateHeight)
 			{
-				return;
+				Left = Tile.GetVertexHeight(FIntPoint(iX - 1, iY));
+				Right = Tile.GetVertexHeight(FIntPoint(iX + 1, iY));
+				Up = Tile.GetVertexHeight(FIntPoint(iX, iY - 1));
+				Down = Tile.GetVertexHeight(FIntPoint(iX, iY + 1));
 			}
-
-			// index array now
-			/* 
-			x 	x 	x 	x
-			x 	5 	6 	x
-			x 	9 	10	x
-			x 	x 	x	x
-			*/
-
-			index = index - 1;
-			index = index - ( iY * RowLength );
-
-			// index array now
-			/* 
-			x 	x 	x 	x
-			x 	0 	1	x
-			x 	0 	1	x
-			x 	x 	x	x
-			*/
-
-			int VerticesPerChunk = RowLength - 2;
-			index = index + (iY-1) * VerticesPerChunk;
-
-			// index array now
-			/*
-				0	1
-				2	3
-			*/
-			OutNormals[index] = Normal;
-			OutTangents[index] = Tangent;
-			},
-		true
-	);
-
-	return;
+			OutNormals.Add(FVector3f(Left - Right, Up - Down, 2.0f * VertexSpacing).GetSafeNormal());
+			OutTangents.Add(FVector3f(2.0f * VertexSpacing, 0.0f, Right - Left).GetSafeNormal());
+		}
+	}
 }
 
 int32 FChunkBuilder::GetIndex(const int32& VertexCount, const FIntPoint& Pos)
@@ -769,12 +1155,23 @@ bool FChunkBuilder::IsGridInChunk(const FIntPoint& Chunk, const FIntPoint& Globa
 	return GetChunk(GlobalGrid) == Chunk;
 }
 
+// same answer as GetPossibleChunks(...).Contains(Chunk), without making the set.
 bool FChunkBuilder::IsGridInChunk(const FIntPoint& Chunk, const FIntPoint& GlobalSmallGrid, const int32& DetailNum)
 {
-	TSet<FIntPoint> Chunks;
-	GetPossibleChunks(GlobalSmallGrid, DetailNum, Chunks);
-	if (Chunks.Contains(Chunk)) return true;
-	else return false;
+	FVector2D ActualPos = GlobalSmallGrid * (VertexSpacing / DetailNum);
+
+	FIntPoint Owner = GetChunk(ActualPos);
+	if (Owner == Chunk) return true;
+
+	float ModX = FMath::Fmod(ActualPos.X, ChunkLength);
+	float ModY = FMath::Fmod(ActualPos.Y, ChunkLength);
+	float SmallValue = VertexSpacing / 5 - 10.f;
+
+	if (FMath::IsNearlyZero(ChunkLength - ModX, SmallValue) && Chunk == Owner + FIntPoint(1, 0)) return true;
+	if (FMath::IsNearlyZero(ChunkLength - ModY, SmallValue) && Chunk == Owner + FIntPoint(0, 1)) return true;
+	if (FMath::IsNearlyZero(ModX, SmallValue) && Chunk == Owner + FIntPoint(-1, 0)) return true;
+	if (FMath::IsNearlyZero(ModY, SmallValue) && Chunk == Owner + FIntPoint(0, -1)) return true;
+	return false;
 }
 
 void FChunkBuilder::GetPossibleChunks(const FIntPoint& GlobalSmallGrid, const int32& DetailNum, TSet<FIntPoint>& OutChunks)
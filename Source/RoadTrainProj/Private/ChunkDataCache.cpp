@@ -0,0 +1,91 @@
+#include "ChunkDataCache.h"
+#include "LandscapeManager.h"
+#include "ChunkBuilder.h"	// FChunkMeshView
+
+FChunkMeshView FCachedChunk::GetView() const
+{
+	FChunkMeshView Mesh;
+	Mesh.LOD = LOD;
+	Mesh.Vertices = Vertices;
+	Mesh.Tangents = Tangents;
+	Mesh.Normals = Normals;
+	Mesh.UVs = UVs;
+	Mesh.Triangles = Triangles;
+	return Mesh;
+}
+
+
+FChunkDataCache::FChunkDataCache(ALandscapeManager* pLM) : HitCount(0), MissCount(0)
+{
+	BudgetBytes = SIZE_T(FMath::Max(pLM->ChunkDataCacheBudgetMB, 0)) * 1024 * 1024;
+
+	// entries differ in size, budget is checked on Add. this is only the upper bound for LRU.
+	Entries.Empty(4096);
+}
+
+FCachedChunkPtr FChunkDataCache::Find(const FChunkDataKey& Key)
+{
+	FCachedChunkPtr Found;
+	{
+		FScopeLock Lock(&Mutex);
+		const FCachedChunkPtr* pFound = Entries.FindAndTouch(Key);
+		if (pFound) Found = *pFound;
+	}
+
+	if (Found) HitCount++;
+	else MissCount++;
+	return Found;
+}
+
+void FChunkDataCache::Add(const FChunkDataKey& Key, const FChunkMeshView& Mesh, const TArray<FVector>& ActualPath)
+{
+	// copied outside the lock.
+	TSharedRef<FCachedChunk, ESPMode::ThreadSafe> Data = MakeShared<FCachedChunk, ESPMode::ThreadSafe>();
+	Data->LOD = Mesh.LOD;
+	Data->Vertices = TArray<FVector3f>(Mesh.Vertices);
+	Data->Tangents = TArray<FVector3f>(Mesh.Tangents);
+	Data->Normals = TArray<FVector3f>(Mesh.Normals);
+	Data->UVs = TArray<FVector2DHalf>(Mesh.UVs);
+	Data->Triangles = TArray<uint32>(Mesh.Triangles);
+	Data->ActualPath = ActualPath;
+
+	SIZE_T EntryBytes = GetEntryBytes(*Data);
+	if (EntryBytes > BudgetBytes) return;
+
+	FScopeLock Lock(&Mutex);
+	const FCachedChunkPtr* pOld = Entries.Find(Key);
+	if (pOld)
+	{
+		Bytes -= GetEntryBytes(**pOld);
+		Entries.Remove(Key);
+	}
+
+	// make room ourselves, so Bytes stays right.
+	while (Entries.Num() > 0 && (Bytes + EntryBytes > BudgetBytes || Entries.Num() >= Entries.Max()))
+	{
+		FCachedChunkPtr Evicted = Entries.RemoveLeastRecent();
+		if (Evicted) Bytes -= GetEntryBytes(*Evicted);
+	}
+
+	Entries.Add(Key, FCachedChunkPtr(Data));
+	Bytes += EntryBytes;
+}
+
+void FChunkDataCache::Empty()
+{
+	FScopeLock Lock(&Mutex);
+	Entries.Empty(Entries.Max());
+	Bytes = 0;
+}
+
+SIZE_T FChunkDataCache::GetBytes()
+{
+	FScopeLock Lock(&Mutex);
+	return Bytes;
+}
+
+SIZE_T FChunkDataCache::GetEntryBytes(const FCachedChunk& Data)
+{
+	return sizeof(FCachedChunk) + Data.Vertices.GetAllocatedSize() + Data.Tangents.GetAllocatedSize() + Data.Normals.GetAllocatedSize()
+		+ Data.UVs.GetAllocatedSize() + Data.Triangles.GetAllocatedSize() + Data.ActualPath.GetAllocatedSize();
+}
@@ -0,0 +1,349 @@
+#include "ChunkDiskCache.h"
+#include "LandscapeManager.h"		// FChunkData, params
+#include "PerlinNoiseVariables.h"	// NoiseLayers
+
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "HAL/RunnableThread.h"
+#include "HAL/Event.h"
+#include "Async/MappedFileHandle.h"
+#include "Misc/Paths.h"
+
+// bump when anything that makes chunks changes. old files are ignored after that.
+static const uint32 ChunkFileMagic = 0x4B435452; // 'RTCK'
+static const uint32 ChunkFileVersion = 1;
+
+// writer falls behind -> chunks just aren't saved this time.
+static const int64 MaxPendingBytes = 64 * 1024 * 1024;
+
+struct FChunkFileHeader
+{
+	uint32 Magic = ChunkFileMagic;
+	uint32 Version = ChunkFileVersion;
+	uint32 ParamHash = 0;
+	uint32 PathVersion = 0;
+	int32 ChunkX = 0;
+	int32 ChunkY = 0;
+	int32 LOD = 0;
+	int32 VertexNum = 0;
+	int32 TriangleNum = 0;	// path layer indices. base grid ones come from LOD.
+	int32 PathNum = 0;
+	int32 Padding[2] = { 0, 0 };	// keeps ActualPath (doubles) 8 byte aligned.
+};
+static_assert(sizeof(FChunkFileHeader) == 48, "chunk file header layout");
+
+// Num elements at Ptr, then moves Ptr past them.
+template<typename ElementType>
+static TConstArrayView<ElementType> TakeChunkFileView(const uint8*& Ptr, const int32& Num)
+{
+	TConstArrayView<ElementType> View(reinterpret_cast<const ElementType*>(Ptr), Num);
+	Ptr += SIZE_T(Num) * sizeof(ElementType);
+	return View;
+}
+
+// bytes after the header.
+static SIZE_T GetChunkFileBodySize(const FChunkFileHeader& Header)
+{
+	return SIZE_T(Header.PathNum) * sizeof(FVector)
+		+ SIZE_T(Header.VertexNum) * (3 * sizeof(FVector3f) + sizeof(FVector2DHalf))
+		+ SIZE_T(Header.TriangleNum) * sizeof(uint32);
+}
+
+
+FChunkDiskCache::FChunkDiskCache(ALandscapeManager* pLM) : HitCount(0), MissCount(0), PendingBytes(0), ShouldStop(false)
+{
+	ParamHash = GetParamHash(pLM);
+	BudgetBytes = int64(FMath::Max(pLM->DiskCacheBudgetMB, 1)) * 1024 * 1024;
+	Directory = FPaths::ProjectSavedDir() / TEXT("ChunkCache") / FString::Printf(TEXT("%08x"), ParamHash);
+
+	// count bound only. bytes are checked on every write.
+	Files.Empty(1 << 20);
+
+	RemoveStaleDirectories();
+	IFileManager::Get().MakeDirectory(*Directory, true);
+	ScanFiles();
+
+	WorkEvent = FPlatformProcess::GetSynchEventFromPool(false);
+	Thread = FRunnableThread::Create(this, TEXT("ChunkDiskWriter"), 0, TPri_Lowest);
+}
+
+FChunkDiskCache::~FChunkDiskCache()
+{
+	if (Thread)
+	{
+		Thread->Kill(true); // calls Stop & waits.
+		delete Thread;
+		Thread = nullptr;
+	}
+	FPlatformProcess::ReturnSynchEventToPool(WorkEvent);
+	WorkEvent = nullptr;
+}
+
+// other params never come back to these. (or they come back rebuilt)
+void FChunkDiskCache::RemoveStaleDirectories()
+{
+	FString Root = FPaths::ProjectSavedDir() / TEXT("ChunkCache");
+	FString Current = FPaths::GetCleanFilename(Directory);
+
+	TArray<FString> Stale;
+	IFileManager::Get().IterateDirectory(*Root, [&Stale, &Current](const TCHAR* Path, bool IsDirectory)
+		{
+			if (IsDirectory && FPaths::GetCleanFilename(Path) != Current) Stale.Add(Path);
+			return true;
+		});
+
+	for (auto& Path : Stale)
+	{
+		if (!IFileManager::Get().DeleteDirectory(*Path, false, true))
+			UE_LOG(LogTemp, Warning, TEXT("ChunkDiskCache: can't remove %s"), *Path);
+	}
+}
+
+// files from earlier launches, oldest first so they're evicted first.
+void FChunkDiskCache::ScanFiles()
+{
+	struct FFoundFile
+	{
+		FString Filename;
+		int64 Size;
+		FDateTime Time;
+	};
+
+	TArray<FFoundFile> Found;
+	IFileManager::Get().IterateDirectoryStat(*Directory, [&Found](const TCHAR* Path, const FFileStatData& Stat)
+		{
+			FString Filename(Path);
+			if (Stat.bIsDirectory) return true;
+			if (Filename.EndsWith(TEXT(".tmp"))) IFileManager::Get().Delete(Path); // writer died mid-file.
+			else if (Filename.EndsWith(TEXT(".chunk"))) Found.Add(FFoundFile{ FPaths::GetCleanFilename(Filename), Stat.FileSize, Stat.ModificationTime });
+			return true;
+		});
+	Found.Sort([](const FFoundFile& A, const FFoundFile& B) { return A.Time < B.Time; });
+
+	FScopeLock Lock(&FilesMutex);
+	for (auto& Elem : Found)
+	{
+		Files.Add(Elem.Filename, Elem.Size);
+		Bytes += Elem.Size;
+	}
+
+	// budget may have shrunk since the last launch.
+	while (Bytes > BudgetBytes && Files.Num() > 0)
+	{
+		IFileManager::Get().Delete(*(Directory / Files.GetLeastRecentKey()), false, false, true);
+		Bytes -= Files.RemoveLeastRecent();
+	}
+}
+
+int64 FChunkDiskCache::GetBytes()
+{
+	FScopeLock Lock(&FilesMutex);
+	return Bytes;
+}
+
+bool FChunkDiskCache::Load(const FChunkDataKey& Key, FChunkBuilder& Builder, FChunkData& OutData, FChunkDataCache* MemoryCache)
+{
+	FString Filename = GetFilename(Key);
+
+	// region is declared after handle, so it's unmapped first.
+	TUniquePtr<IMappedFileHandle> Handle(FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*Filename));
+	if (!Handle || Handle->GetFileSize() < int64(sizeof(FChunkFileHeader)))
+	{
+		MissCount++;
+		return false;
+	}
+	TUniquePtr<IMappedFileRegion> Region(Handle->MapRegion(0, Handle->GetFileSize()));
+	if (!Region)
+	{
+		MissCount++;
+		return false;
+	}
+
+	const uint8* Ptr = Region->GetMappedPtr();
+	FChunkFileHeader Header;
+	FMemory::Memcpy(&Header, Ptr, sizeof(FChunkFileHeader));
+
+	bool IsFileValid = Header.Magic == ChunkFileMagic && Header.Version == ChunkFileVersion && Header.ParamHash == ParamHash
+		&& Header.PathVersion == Key.PathVersion && FIntPoint(Header.ChunkX, Header.ChunkY) == Key.Chunk && Header.LOD == Key.LOD
+		&& Header.VertexNum >= 0 && Header.TriangleNum >= 0 && Header.PathNum >= 0 && Header.TriangleNum % 3 == 0
+		&& SIZE_T(Region->GetMappedSize()) == sizeof(FChunkFileHeader) + GetChunkFileBodySize(Header);
+	if (!IsFileValid)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("ChunkDiskCache: ignoring %s"), *Filename);
+		MissCount++;
+		return false;
+	}
+	Ptr += sizeof(FChunkFileHeader);
+
+	// views into the mapping. nothing is copied until the stream set is packed.
+	TConstArrayView<FVector> Path = TakeChunkFileView<FVector>(Ptr, Header.PathNum);
+
+	FChunkMeshView Mesh;
+	Mesh.LOD = Header.LOD;
+	Mesh.Vertices = TakeChunkFileView<FVector3f>(Ptr, Header.VertexNum);
+	Mesh.Tangents = TakeChunkFileView<FVector3f>(Ptr, Header.VertexNum);
+	Mesh.Normals = TakeChunkFileView<FVector3f>(Ptr, Header.VertexNum);
+	Mesh.Triangles = TakeChunkFileView<uint32>(Ptr, Header.TriangleNum);
+	Mesh.UVs = TakeChunkFileView<FVector2DHalf>(Ptr, Header.VertexNum);
+
+	// a broken file shouldn't take the mesh down with it.
+	for (const uint32& Index : Mesh.Triangles)
+	{
+		if (Index < uint32(Header.VertexNum)) continue;
+		UE_LOG(LogTemp, Warning, TEXT("ChunkDiskCache: bad index in %s"), *Filename);
+		MissCount++;
+		return false;
+	}
+
+	RealtimeMesh::FRealtimeMeshStreamSet StreamSet;
+	int32 MeshBytes = Builder.GetStreamSet(Mesh, StreamSet);
+
+	OutData = FChunkData(Key.Chunk, MoveTemp(StreamSet), TArray<FVector>(Path), Key.LOD);
+	OutData.MeshBytes = MeshBytes;
+	if (MemoryCache) MemoryCache->Add(Key, Mesh, OutData.ActualPath);
+	HitCount++;
+
+	// recently used now. (this launch only, mtime stays the write time)
+	FScopeLock Lock(&FilesMutex);
+	Files.FindAndTouch(FPaths::GetCleanFilename(Filename));
+	return true;
+}
+
+// packs the file here, the mesh views point at the builder's scratch. writing is the writer thread's.
+void FChunkDiskCache::Save(const FChunkDataKey& Key, const FChunkMeshView& Mesh, const TArray<FVector>& ActualPath)
+{
+	FChunkFileHeader Header;
+	Header.ParamHash = ParamHash;
+	Header.PathVersion = Key.PathVersion;
+	Header.ChunkX = Key.Chunk.X;
+	Header.ChunkY = Key.Chunk.Y;
+	Header.LOD = Key.LOD;
+	Header.VertexNum = Mesh.Vertices.Num();
+	Header.TriangleNum = Mesh.Triangles.Num();
+	Header.PathNum = ActualPath.Num();
+
+	const int64 FileBytes = int64(sizeof(FChunkFileHeader) + GetChunkFileBodySize(Header));
+	if (FileBytes > BudgetBytes || PendingBytes + FileBytes > MaxPendingBytes) return;
+
+	FWrite Job;
+	Job.Filename = GetFilename(Key);
+	Job.Data.Reserve(FileBytes);
+	auto Append = [&Job](const void* Data, const SIZE_T& Bytes) { Job.Data.Append(static_cast<const uint8*>(Data), int32(Bytes)); };
+	Append(&Header, sizeof(FChunkFileHeader));
+	Append(ActualPath.GetData(), ActualPath.Num() * sizeof(FVector));
+	Append(Mesh.Vertices.GetData(), Mesh.Vertices.Num() * sizeof(FVector3f));
+	Append(Mesh.Tangents.GetData(), Mesh.Tangents.Num() * sizeof(FVector3f));
+	Append(Mesh.Normals.GetData(), Mesh.Normals.Num() * sizeof(FVector3f));
+	Append(Mesh.Triangles.GetData(), Mesh.Triangles.Num() * sizeof(uint32));
+	Append(Mesh.UVs.GetData(), Mesh.UVs.Num() * sizeof(FVector2DHalf));
+
+	PendingBytes += FileBytes;
+	Writes.Enqueue(MoveTemp(Job));
+	WorkEvent->Trigger();
+}
+
+uint32 FChunkDiskCache::Run()
+{
+	while (!ShouldStop)
+	{
+		FWrite Job;
+		if (!Writes.Dequeue(Job))
+		{
+			WorkEvent->Wait(100); // ms. wakes on Save anyway.
+			continue;
+		}
+
+		Write(Job);
+		PendingBytes -= Job.Data.Num();
+	}
+	return 0;
+}
+
+void FChunkDiskCache::Stop()
+{
+	ShouldStop = true;
+	WorkEvent->Trigger();
+}
+
+// temp file, then rename. a reader never maps half a file. oldest files go over budget.
+void FChunkDiskCache::Write(FWrite& Job)
+{
+	const FString& Filename = Job.Filename;
+	FString TempFilename = Filename + TEXT(".tmp");
+
+	FArchive* Writer = IFileManager::Get().CreateFileWriter(*TempFilename);
+	if (!Writer)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("ChunkDiskCache: can't write %s"), *TempFilename);
+		return;
+	}
+
+	Writer->Serialize(Job.Data.GetData(), Job.Data.Num());
+	bool Failed = Writer->IsError();
+	Writer->Close();
+	delete Writer;
+
+	if (Failed || !IFileManager::Get().Move(*Filename, *TempFilename, true))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("ChunkDiskCache: can't save %s"), *Filename);
+		IFileManager::Get().Delete(*TempFilename);
+		return;
+	}
+
+	FString Key = FPaths::GetCleanFilename(Filename);
+	TArray<FString> Evicted;
+	{
+		FScopeLock Lock(&FilesMutex);
+		const int64* pOld = Files.Find(Key);
+		if (pOld)
+		{
+			Bytes -= *pOld;
+			Files.Remove(Key);
+		}
+		Files.Add(Key, Job.Data.Num());
+		Bytes += Job.Data.Num();
+
+		while (Bytes > BudgetBytes && Files.Num() > 1)
+		{
+			Evicted.Add(Files.GetLeastRecentKey());
+			Bytes -= Files.RemoveLeastRecent();
+		}
+	}
+
+	// a file mapped by Load right now can fail to delete. it's just left, ScanFiles picks it up next launch.
+	for (auto& Elem : Evicted) IFileManager::Get().Delete(*(Directory / Elem), false, false, true);
+}
+
+FString FChunkDiskCache::GetFilename(const FChunkDataKey& Key)
+{
+	return Directory / FString::Printf(TEXT("%d_%d_%d_%08x.chunk"), Key.Chunk.X, Key.Chunk.Y, Key.LOD, Key.PathVersion);
+}
+
+// everything chunk meshes & roads are made from. noise offsets too, so it only matches across launches with a seed.
+uint32 FChunkDiskCache::GetParamHash(ALandscapeManager* pLM)
+{
+	uint32 Hash = GetTypeHash(ChunkFileVersion);
+	Hash = HashCombine(Hash, GetTypeHash(pLM->VertexSpacing));
+	Hash = HashCombine(Hash, GetTypeHash(pLM->VerticesPerChunk));
+	Hash = HashCombine(Hash, GetTypeHash(pLM->TextureSize));
+	Hash = HashCombine(Hash, GetTypeHash(pLM->ShouldGenerateHeight));
+	for (auto& Layer : pLM->NoiseLayers)
+	{
+		Hash = HashCombine(Hash, GetTypeHash(Layer.Frequency));
+		Hash = HashCombine(Hash, GetTypeHash(Layer.Amplitude));
+		Hash = HashCombine(Hash, GetTypeHash(Layer.Offset));
+	}
+
+	Hash = HashCombine(Hash, GetTypeHash(pLM->CoverageRadius));
+	Hash = HashCombine(Hash, GetTypeHash(pLM->DetailCount));
+	Hash = HashCombine(Hash, GetTypeHash(pLM->RoadSmoothRadius));
+	Hash = HashCombine(Hash, GetTypeHash(pLM->MaxChunkLOD));
+	Hash = HashCombine(Hash, GetTypeHash(pLM->LODSkirtDepth));
+
+	Hash = HashCombine(Hash, GetTypeHash(pLM->MaxSlope));
+	Hash = HashCombine(Hash, GetTypeHash(pLM->SlopeViolationPanelty));
+	Hash = HashCombine(Hash, GetTypeHash(pLM->MinTurnRadius));
+	Hash = HashCombine(Hash, GetTypeHash(pLM->CounterHardLock));
+	Hash = HashCombine(Hash, GetTypeHash(pLM->EntrancesPerEdge));
+	return Hash;
+}
@@ -0,0 +1,92 @@
+#include "HeightCache.h"
+#include "LandscapeManager.h"
+#include "PerlinNoiseVariables.h"   // NoiseLayers
+
+
+FHeightCache::FHeightCache(ALandscapeManager* pLM) : pLM(pLM), HitCount(0), MissCount(0)
+{
+	VerticesPerChunk = pLM->VerticesPerChunk;
+	VertexSpacing = pLM->VertexSpacing;
+	ChunkLength = (VerticesPerChunk - 1) * VertexSpacing;
+	ParamHash = GetParamHash();
+
+	// budget -> number of tiles. every tile has the same size.
+	SIZE_T TileBytes = sizeof(FHeightTile) + sizeof(float) * ( FMath::Square(VerticesPerChunk + 2) + FMath::Square(VerticesPerChunk + 1) );
+	SIZE_T Budget = SIZE_T(FMath::Max(pLM->HeightCacheBudgetMB, 1)) * 1024 * 1024;
+	int32 MaxTiles = FMath::Max(int32(Budget / TileBytes), 9); // at least 3x3 around one chunk.
+
+	Tiles.Empty(MaxTiles);
+}
+
+FHeightTilePtr FHeightCache::GetTile(const FIntPoint& Chunk)
+{
+	FHeightTileKey Key(Chunk, ParamHash);
+	{
+		FScopeLock Lock(&Mutex);
+		const FHeightTilePtr* Found = Tiles.FindAndTouch(Key);
+		if (Found)
+		{
+			HitCount++;
+			return *Found;
+		}
+	}
+
+	// build without lock. other threads may build the same tile meanwhile, first one wins.
+	MissCount++;
+	FHeightTilePtr NewTile = BuildTile(Chunk);
+
+	FScopeLock Lock(&Mutex);
+	const FHeightTilePtr* Found = Tiles.FindAndTouch(Key);
+	if (Found) return *Found;
+
+	Tiles.Add(Key, NewTile);
+	return NewTile;
+}
+
+void FHeightCache::Empty()
+{
+	FScopeLock Lock(&Mutex);
+	Tiles.Empty(Tiles.Max());
+}
+
+FHeightTilePtr FHeightCache::BuildTile(const FIntPoint& Chunk)
+{
+	TSharedPtr<FHeightTile, ESPMode::ThreadSafe> Tile = MakeShared<FHeightTile, ESPMode::ThreadSafe>();
+	Tile->Chunk = Chunk;
+	Tile->VertexRow = VerticesPerChunk + 2;
+	Tile->CellRow = VerticesPerChunk + 1;
+
+	// vertices. same positions as FChunkBuilder::GetVertices, border for GetTangents.
+	FVector2D Offset = FVector2D(Chunk.X, Chunk.Y) * ChunkLength;
+	pLM->GetHeights(Offset, VertexSpacing, FIntPoint(-1, -1), FIntPoint(Tile->VertexRow, Tile->VertexRow), Tile->VertexHeights);
+
+	// cell centers. same positions as FPathFinder::GetCellHeight.
+	TArray<FVector2D> CellCenters;
+	CellCenters.Reserve(FMath::Square(Tile->CellRow));
+	FIntPoint ChunkGrid = Chunk * (VerticesPerChunk - 1);
+	for (int32 iY = -1; iY < Tile->CellRow - 1; iY++)
+	{
+		for (int32 iX = -1; iX < Tile->CellRow - 1; iX++)
+		{
+			FIntPoint GlobalGrid = ChunkGrid + FIntPoint(iX, iY);
+			CellCenters.Add(FVector2D(GlobalGrid.X + 0.5f, GlobalGrid.Y + 0.5f) * VertexSpacing);
+		}
+	}
+	pLM->GetHeights(CellCenters, Tile->CellHeights);
+
+	return Tile;
+}
+
+uint32 FHeightCache::GetParamHash()
+{
+	uint32 Hash = GetTypeHash(pLM->ShouldGenerateHeight);
+	Hash = HashCombine(Hash, GetTypeHash(VerticesPerChunk));
+	Hash = HashCombine(Hash, GetTypeHash(VertexSpacing));
+	for (auto& Layer : pLM->NoiseLayers)
+	{
+		Hash = HashCombine(Hash, GetTypeHash(Layer.Frequency));
+		Hash = HashCombine(Hash, GetTypeHash(Layer.Amplitude));
+		Hash = HashCombine(Hash, GetTypeHash(Layer.Offset));
+	}
+	return Hash;
+}
@@ -1,11 +1,34 @@
 
 #include "LandscapeManager.h"
 #include "PerlinNoiseVariables.h"
+#include "RoadTrainProj.h" // stats
 
 #include "Components/SplineComponent.h" // Spline
 #include "Components/SplineMeshComponent.h" // Spline Mesh
 
 #include "DrawDebugHelpers.h"
+#include "HAL/LowLevelMemTracker.h" // LLM tags
+
+DECLARE_CYCLE_STAT(TEXT("Chunk Integration"), STAT_ChunkIntegration, STATGROUP_RoadTrain);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Integration Budget (ms)"), STAT_IntegrationBudgetMs, STATGROUP_RoadTrain);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Integration Used (ms)"), STAT_IntegrationUsedMs, STATGROUP_RoadTrain);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Average AddChunk (ms)"), STAT_AverageAddChunkMs, STATGROUP_RoadTrain);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Average RemoveChunk (ms)"), STAT_AverageRemoveChunkMs, STATGROUP_RoadTrain);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Integrated Items"), STAT_IntegratedItems, STATGROUP_RoadTrain);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Chunk Pool Hits"), STAT_ChunkPoolHits, STATGROUP_RoadTrain);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Chunk Pool Misses"), STAT_ChunkPoolMisses, STATGROUP_RoadTrain);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Dropped Chunk Builds"), STAT_DroppedChunkBuilds, STATGROUP_RoadTrain);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Horizon Build (ms)"), STAT_HorizonBuildMs, STATGROUP_RoadTrain);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Chunk Mesh (KB)"), STAT_ChunkMeshKB, STATGROUP_RoadTrain);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Chunk Layout Saved (KB)"), STAT_ChunkLayoutSavedKB, STATGROUP_RoadTrain);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Chunk Data Cache Hit Rate (%)"), STAT_ChunkDataCacheHitRate, STATGROUP_RoadTrain);
+DECLARE_MEMORY_STAT(TEXT("Chunk Data Cache"), STAT_ChunkDataCacheMemory, STATGROUP_RoadTrain);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Chunk Disk Cache Hit Rate (%)"), STAT_ChunkDiskCacheHitRate, STATGROUP_RoadTrain);
+
+// scheduler key of the horizon job. far out of any chunk we'll ever stream.
+static const FIntPoint HorizonJobKey = FIntPoint(MIN_int32, MIN_int32);
+// same for the planning job. one pass at a time.
+static const FIntPoint PlanJobKey = FIntPoint(MIN_int32, MIN_int32 + 1);
 
 
 ALandscapeManager::ALandscapeManager()
@@ -20,11 +43,9 @@ ALandscapeManager::ALandscapeManager()
 	IsPath = false;
 	ChunkLength = (VerticesPerChunk - 1) * VertexSpacing;
 
-	FrameCounter = 0;
 	ShouldWorkCounter = 0;
 
 	UpdateDelayFrames = 2;
-	DoWorkFrame = 3;
 
 	UseAsync = true;
 
@@ -38,13 +59,22 @@ void ALandscapeManager::OnConstruction(const FTransform& Transform)
 {
 	Super::OnConstruction(Transform);
 
-	GetChunkOrder(ChunkRadius, ChunkOrder);
-	GetChunkOrder(ChunkRadius + 1, BigChunkOrder);
+	MaxChunkRadius = FMath::Max(MaxChunkRadius, ChunkRadius);
+	RoadSmoothRadius = FMath::Min(RoadSmoothRadius, CoverageRadius * DetailCount); // wider box never fits in the road layer.
+	GetChunkOrder(MaxChunkRadius, ChunkOrder);
+	GetChunkOrder(MaxChunkRadius + MaxPrefetchChunks + 1, BigChunkOrder);
+	ActiveChunkRadius = ChunkRadius;
+	CurrentChunkRadius = ChunkRadius;
 
 	ChunkLength = (VerticesPerChunk - 1) * VertexSpacing;
 
+	PathService.reset(); // its jobs use PathFinder.
 	ChunkBuilder = std::make_unique<FChunkBuilder>(this, this->Material);
 	PathFinder = std::make_unique<FPathFinder>(this);
+	PathService = std::make_unique<FPathService>();
+	HeightCache = std::make_unique<FHeightCache>(this);
+	if (ChunkDataCacheBudgetMB > 0) ChunkDataCache = std::make_unique<FChunkDataCache>(this);
+	else ChunkDataCache.reset();
 }
 
 void ALandscapeManager::Tick(float DeltaTime)
@@ -56,6 +86,14 @@ void ALandscapeManager::Tick(float DeltaTime)
 	// only if async below ( it's kind of always )
 	if (!UseAsync) return;
 
+	if (ChunkScheduler) ChunkScheduler->UpdateStats();
+	if (PathService)
+	{
+		PathQueueLength = PathService->GetQueueLength();
+		PathLatencyMs = PathService->GetAverageLatencyMs();
+	}
+	UpdateChunkRadius(DeltaTime);
+
 	FIntPoint ChunkNow = GetChunk(GetPlayerLocation());
 	if (ShouldDoWork(ChunkNow))
 	{
@@ -63,19 +101,16 @@ void ALandscapeManager::Tick(float DeltaTime)
 		AsyncWork(ChunkNow);
 	}
 
-	if (FrameCounter % DoWorkFrame == 0)
-	{
-		FrameCounter = 0;
-		Process(ChunkNow);
-	}
-	FrameCounter++;
+	Process(ChunkNow);
+	if (ShowHorizon) UpdateHorizon(ChunkNow);
 
 	if (!IsFirstGenDone) // only on first loading.
 	{
 		while (DequeueAndAddChunk(ChunkNow)); // if this thingy returns true ( added a chunk ) do it again
 
 		FRWScopeLock Lock(RWChunksMutex, FRWScopeLockType::SLT_ReadOnly);
-		if ((ChunkRadius * 2 + 1) * (ChunkRadius * 2 + 1) <= Chunks.Num())  // if all chunks added return.
+		int32 Radius = ActiveChunkRadius;
+		if ((Radius * 2 + 1) * (Radius * 2 + 1) <= Chunks.Num())  // if all chunks added return.
 		{
 			IsFirstGenDone = true;
 			OnFirstGenDone.Broadcast();
@@ -90,19 +125,45 @@ void ALandscapeManager::BeginPlay()
 	Super::BeginPlay();
 
 	// on construction.
-	GetChunkOrder(ChunkRadius, ChunkOrder);
-	GetChunkOrder(ChunkRadius + 1, BigChunkOrder);
+	MaxChunkRadius = FMath::Max(MaxChunkRadius, ChunkRadius);
+	RoadSmoothRadius = FMath::Min(RoadSmoothRadius, CoverageRadius * DetailCount); // wider box never fits in the road layer.
+	GetChunkOrder(MaxChunkRadius, ChunkOrder);
+	GetChunkOrder(MaxChunkRadius + MaxPrefetchChunks + 1, BigChunkOrder);
+	ActiveChunkRadius = ChunkRadius;
+	CurrentChunkRadius = ChunkRadius;
 
 	ChunkLength = (VerticesPerChunk - 1) * VertexSpacing;
 
 	// adding random offset to Height layers before giving it to ChunkBuilder & PathFinder
+	FRandomStream Random(Seed);
 	for (int32 i = 0; i < NoiseLayers.Num(); i++)
-		NoiseLayers[i].Offset = FMath::FRandRange(-10.f, 10.f);
+		NoiseLayers[i].Offset = UseSeed ? Random.FRandRange(-10.f, 10.f) : FMath::FRandRange(-10.f, 10.f);
 
+	PathService.reset(); // its jobs use PathFinder.
 	ChunkBuilder = std::make_unique<FChunkBuilder>(this, this->Material);
 	PathFinder = std::make_unique<FPathFinder>(this);
+	PathService = std::make_unique<FPathService>();
+	HeightCache = std::make_unique<FHeightCache>(this);
+	if (ChunkDataCacheBudgetMB > 0) ChunkDataCache = std::make_unique<FChunkDataCache>(this);
+	else ChunkDataCache.reset();
 	// on construction.
 
+	// random offsets would never match a file from another launch.
+	if (UseDiskCache && UseSeed) ChunkDiskCache = std::make_unique<FChunkDiskCache>(this);
+	else if (UseDiskCache) UE_LOG(LogTemp, Warning, TEXT("LandscapeManager: UseDiskCache needs UseSeed, disk cache is off"));
+
+	int32 WorkerNum = ChunkBuildWorkers;
+	if (WorkerNum <= 0) WorkerNum = FMath::Max(FPlatformMisc::NumberOfCoresIncludingHyperthreads() - 2, 1);
+	EThreadPriority Priority = TPri_BelowNormal;
+	switch (ChunkBuildPriority)
+	{
+	case EChunkBuildPriority::Normal: Priority = TPri_Normal; break;
+	case EChunkBuildPriority::Lowest: Priority = TPri_Lowest; break;
+	default: break;
+	}
+	ChunkScheduler = std::make_unique<FChunkBuildScheduler>(WorkerNum, Priority);
+
+	CancelGoalUpdate();
 	GatePath.Empty();
 	GateMap.Empty();
 
@@ -124,17 +185,35 @@ void ALandscapeManager::BeginPlay()
 
 }
 
+void ALandscapeManager::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	// stop build threads before anything they use goes away.
+	PathService.reset();
+	ChunkScheduler.reset();
+	ChunkDiskCache.reset();
+	Super::EndPlay(EndPlayReason);
+}
+
+// editor actors never EndPlay. service callbacks hold this.
+void ALandscapeManager::BeginDestroy()
+{
+	PathService.reset();
+	Super::BeginDestroy();
+}
+
 void ALandscapeManager::GenerateLandscape()
 {
 	RemoveLandscape();
 
 	TArray<FVector> EmptyArray;
 	EmptyArray.Empty();
-	for (auto& Elem : ChunkOrder)
+	for (int32 i = 0; i < GetOrderNum(ActiveChunkRadius, ChunkOrder); i++)
 	{
+		const FIntPoint& Elem = ChunkOrder[i];
+		int32 LOD = GetChunkLOD(FIntPoint(0, 0), Elem);
 		RealtimeMesh::FRealtimeMeshStreamSet StreamSet;
-		ChunkBuilder->GetStreamSet(Elem, EmptyArray, StreamSet);
-		AddChunk(Elem, StreamSet);
+		ChunkBuilder->GetStreamSet(Elem, EmptyArray, StreamSet, LOD);
+		AddChunk(Elem, MoveTemp(StreamSet), LOD);
 	}
 }
 
@@ -144,10 +223,12 @@ void ALandscapeManager::GenerateLandscapeWithPath()
 
 	GatePath.Empty();
 	PathFinder->GetGatePath(Start, End, GatePath);
+	PathFinder->EmptyPathCache();
 	UpdateGateMap();
 
-	for (auto& Chunk : ChunkOrder)
+	for (int32 Index = 0; Index < GetOrderNum(ActiveChunkRadius, ChunkOrder); Index++)
 	{
+		const FIntPoint& Chunk = ChunkOrder[Index];
 		TArray<FVector> Paths;
 		TArray<FVector> PathForSpline;
 
@@ -168,11 +249,12 @@ void ALandscapeManager::GenerateLandscapeWithPath()
 				}
 			}
 
+		int32 LOD = GetChunkLOD(FIntPoint(0, 0), Chunk);
 		RealtimeMesh::FRealtimeMeshStreamSet StreamSet;
-		ChunkBuilder->GetStreamSet(Chunk, Paths, StreamSet);
-		AddChunk(Chunk, StreamSet);
+		ChunkBuilder->GetStreamSet(Chunk, Paths, StreamSet, LOD);
+		AddChunk(Chunk, MoveTemp(StreamSet), LOD);
 
-		if (!PathForSpline.IsEmpty())
+		if (!PathForSpline.IsEmpty() && LOD == 0)
 		{
 			USplineComponent* pSpline = AddPathSpline(Chunk, PathForSpline);
 			if(pSpline) MakeRoad(pSpline);
@@ -191,16 +273,38 @@ void ALandscapeManager::RemoveLandscape()
 	for (auto& Elem : Chunks) RemoveSet.Add(Elem.Key);
 	for (auto& Elem : RemoveSet) RemoveChunk(Elem);
 
-	Chunks.Empty();
+	{
+		FRWScopeLock Lock(RWChunksMutex, FRWScopeLockType::SLT_Write);
+		Chunks.Empty();
+		ChunkLODs.Empty();
+	}
+	EmptyChunkPool();
+	RemoveHorizon();
+	CancelGoalUpdate();
 }
 
 void ALandscapeManager::Debug()
 {
 	FlushPersistentDebugLines(GetWorld());
+	if (!PathService) return;
 
-	TMap<FIntPoint, TPair<FGate, float>> Gates;
-	PathFinder->GetGates(FGate(Start), Start, Gates, true);
-	
+	// search on the service, drawing on the game thread. only the gates it found are drawn.
+	typedef TMap<FIntPoint, TPair<FGate, float>> FGates;
+	PathService->Enqueue<FGates>(EPathJobPriority::Low,
+		[this](const FPathJobState& State, FGates& OutGates) -> bool
+		{
+			PathFinder->GetGates(FGate(Start), Start, OutGates);
+			return true;
+		},
+		[this](FGates&& Gates)
+		{
+			for (auto& Elem : Gates)
+			{
+				DrawDebugPoint(GetWorld(), GridToVector(Elem.Value.Key.A), 8.f, FColor::Red, true);
+				DrawDebugPoint(GetWorld(), GridToVector(Elem.Value.Key.B), 8.f, FColor::Red, true);
+			}
+		}
+	);
 }
 
 
@@ -228,7 +332,58 @@ TArray<USplineComponent*> ALandscapeManager::GetNearSplines()
 	return NearSplines;
 }
 
+// blocks the game thread for up to SpawnPosTimeoutMs. High, but it still waits for the running job (any priority)
+// and for High jobs queued before it, like a goal extension. false on timeout, RequestSpawnPos doesn't block.
 bool ALandscapeManager::GetSpawnPos(FVector& OutVector)
+{
+	const uint32 SpawnPosTimeoutMs = 200;
+
+	OutVector = FVector::ZeroVector;
+	if (!PathService) return false;
+
+	// the job may still run after a timeout, so it shares the event & result instead of borrowing them.
+	struct FSpawnResult
+	{
+		FSpawnResult() { DoneEvent = FPlatformProcess::GetSynchEventFromPool(true); }
+		~FSpawnResult() { FPlatformProcess::ReturnSynchEventToPool(DoneEvent); }
+
+		FEvent* DoneEvent;
+		bool Found = false;
+		FVector Pos = FVector::ZeroVector;
+	};
+	TSharedRef<FSpawnResult, ESPMode::ThreadSafe> Result = MakeShared<FSpawnResult, ESPMode::ThreadSafe>();
+
+	FPathJobHandle Job = PathService->Enqueue(EPathJobPriority::High,
+		[this, Result](const FPathJobState& State) -> bool
+		{
+			Result->Found = FindSpawnPos(Result->Pos);
+			Result->DoneEvent->Trigger();
+			return false;
+		}
+	);
+
+	if (!Result->DoneEvent->Wait(SpawnPosTimeoutMs))
+	{
+		Job->Cancelled = true; // skipped if it hasn't started.
+		UE_LOG(LogTemp, Warning, TEXT("GetSpawnPos timed out, path service busy"));
+		return false;
+	}
+
+	OutVector = Result->Pos;
+	return Result->Found;
+}
+
+void ALandscapeManager::RequestSpawnPos()
+{
+	if (!PathService) return;
+
+	PathService->Enqueue<FVector>(EPathJobPriority::Normal,
+		[this](const FPathJobState& State, FVector& OutPos) -> bool { return FindSpawnPos(OutPos); },
+		[this](FVector&& Pos) { OnSpawnPosFound.Broadcast(Pos); }
+	);
+}
+
+bool ALandscapeManager::FindSpawnPos(FVector& OutVector)
 {
 
 	OutVector = FVector::ZeroVector;
@@ -269,6 +424,22 @@ float ALandscapeManager::GetHeight( const FVector2D& Location )
 	return ChunkBuilder->GetHeight(Location);
 }
 
+void ALandscapeManager::GetHeights(const FVector2D& Origin, const float& Spacing, const FIntPoint& StartIndex, const FIntPoint& Count, TArray<float>& OutHeights)
+{
+	ChunkBuilder->GetHeights(Origin, Spacing, StartIndex, Count, OutHeights);
+}
+
+void ALandscapeManager::GetHeights(const TArray<FVector2D>& Locations, TArray<float>& OutHeights)
+{
+	ChunkBuilder->GetHeights(Locations, OutHeights);
+}
+
+// thread safe. heights of whole chunk, shared by every thread.
+FHeightTilePtr ALandscapeManager::GetHeightTile(const FIntPoint& Chunk)
+{
+	return HeightCache->GetTile(Chunk);
+}
+
 // returns center of grid.
 FVector ALandscapeManager::GridToVector(const FIntPoint& GlobalGrid)
 {
@@ -301,7 +472,8 @@ FIntPoint ALandscapeManager::GetChunk(const FVector& Vector)
 
 
 // Add Chunk as an Actor into the world.
-void ALandscapeManager::AddChunk(const FIntPoint& Chunk, const RealtimeMesh::FRealtimeMeshStreamSet& StreamSet)
+// StreamSet is moved into the mesh.
+void ALandscapeManager::AddChunk(const FIntPoint& Chunk, RealtimeMesh::FRealtimeMeshStreamSet&& StreamSet, const int32& LOD)
 {
 
 	UWorld* pWorld = GetWorld();
@@ -309,8 +481,39 @@ void ALandscapeManager::AddChunk(const FIntPoint& Chunk, const RealtimeMesh::FRe
 	{ UE_LOG(LogTemp, Warning, TEXT("GetWorld() nullptr")); 
 	return; }
 
+	const FRealtimeMeshSectionGroupKey GroupKey = FRealtimeMeshSectionGroupKey::Create(0, 0);
+	const FRealtimeMeshSectionKey PolyGroup0SectionKey = FRealtimeMeshSectionKey::CreateForPolyGroup(GroupKey, 0);
+
+	// recycled actor already has its mesh, material slot, LOD config & section config.
+	ARealtimeMeshActor* pRMA = nullptr;
+	while (!ChunkPool.IsEmpty() && !IsValid(pRMA)) pRMA = ChunkPool.Pop(EAllowShrinking::No);
+
+	if (IsValid(pRMA))
+	{
+		PoolHitCount++;
+		URealtimeMeshSimple* RealtimeMesh = pRMA->GetRealtimeMeshComponent()->GetRealtimeMeshAs<URealtimeMeshSimple>();
+		if (!RealtimeMesh)
+		{ UE_LOG(LogTemp, Warning, TEXT("Pooled RealtimeMesh nullptr"));
+		return; }
+
+		FVector Offset = FVector( Chunk.X , Chunk.Y, 0.0f ) * ChunkLength;
+		pRMA->SetActorLocation(Offset);
+
+		// new stream data only.
+		RealtimeMesh->UpdateSectionGroup(GroupKey, MoveTemp(StreamSet));
+
+		pRMA->SetActorHiddenInGame(false);
+		pRMA->SetActorEnableCollision(true);
+
+		FRWScopeLock Lock(RWChunksMutex, FRWScopeLockType::SLT_Write);
+		Chunks.Add(Chunk, pRMA);
+		ChunkLODs.Add(Chunk, LOD);
+		return;
+	}
+	PoolMissCount++;
+
 	// Spawn chunk as Actor
-	ARealtimeMeshActor* pRMA = pWorld->SpawnActor<ARealtimeMeshActor>();
+	pRMA = pWorld->SpawnActor<ARealtimeMeshActor>();
 	if (!pRMA)
 	{ UE_LOG(LogTemp, Warning, TEXT("RMA nullptr")); 
 	return; }
@@ -334,11 +537,8 @@ void ALandscapeManager::AddChunk(const FIntPoint& Chunk, const RealtimeMesh::FRe
 	RealtimeMesh->SetupMaterialSlot(0, "PrimaryMaterial");
 	RealtimeMesh->UpdateLODConfig(0, FRealtimeMeshLODConfig(1.00f));
 
-	const FRealtimeMeshSectionGroupKey GroupKey = FRealtimeMeshSectionGroupKey::Create(0, 0);
-	const FRealtimeMeshSectionKey PolyGroup0SectionKey = FRealtimeMeshSectionKey::CreateForPolyGroup(GroupKey, 0);
-
 	// this generates the mesh (chunk)
-	RealtimeMesh->CreateSectionGroup(GroupKey, StreamSet);
+	RealtimeMesh->CreateSectionGroup(GroupKey, MoveTemp(StreamSet));
 
 	// set Mobility
 	pRMA->GetRootComponent()->SetMobility(EComponentMobility::Movable);
@@ -351,6 +551,7 @@ void ALandscapeManager::AddChunk(const FIntPoint& Chunk, const RealtimeMesh::FRe
 	{ // scopelock writing.
 		FRWScopeLock Lock(RWChunksMutex, FRWScopeLockType::SLT_Write);
 		Chunks.Add(Chunk, pRMA); 
+		ChunkLODs.Add(Chunk, LOD);
 	}
 	
 
@@ -361,23 +562,192 @@ void ALandscapeManager::AddChunk(const FIntPoint& Chunk, const RealtimeMesh::FRe
 }
 
 // check and remove chunk and entry from Member::Chunks TMap
+// actor goes back to pool if there's room, destroyed otherwise.
 bool ALandscapeManager::RemoveChunk(const FIntPoint& Chunk)
 {
 	ARealtimeMeshActor** ppRMA = Chunks.Find(Chunk);
-	bool Destroyed = false;
-	if ( ppRMA && (*ppRMA) )
+	bool Removed = false;
+	if ( ppRMA && IsValid(*ppRMA) )
 	{
-		Destroyed = (*ppRMA)->Destroy();
+		ARealtimeMeshActor* pRMA = *ppRMA;
+		// two rows of chunks. what one diagonal chunk step removes & adds.
+		int32 MaxPoolSize = (ActiveChunkRadius * 2 + 1) * 2;
+		if (ChunkPool.Num() < MaxPoolSize)
+		{
+			// road belongs to the chunk, not the actor.
+			ClearPathSpline(pRMA);
+
+			pRMA->SetActorHiddenInGame(true);
+			pRMA->SetActorEnableCollision(false);
+			ChunkPool.Add(pRMA);
+			Removed = true;
+		}
+		else Removed = pRMA->Destroy();
 	}
-	if (Destroyed)
+	if (Removed)
 	{
 		// scopelock writing.
 		FRWScopeLock Lock(RWChunksMutex, FRWScopeLockType::SLT_Write);
 		Chunks.Remove(Chunk);
+		ChunkLODs.Remove(Chunk);
 	}
 	return true;
 }
 
+// new stream data on the same actor. neighbors are left alone, skirts cover the seams.
+void ALandscapeManager::UpdateChunk(const FIntPoint& Chunk, RealtimeMesh::FRealtimeMeshStreamSet&& StreamSet, const int32& LOD)
+{
+	ARealtimeMeshActor** ppRMA = Chunks.Find(Chunk);
+	if (!ppRMA || !IsValid(*ppRMA))
+	{ UE_LOG(LogTemp, Warning, TEXT("UpdateChunk on missing chunk"));
+	return; }
+
+	URealtimeMeshSimple* RealtimeMesh = (*ppRMA)->GetRealtimeMeshComponent()->GetRealtimeMeshAs<URealtimeMeshSimple>();
+	if (!RealtimeMesh)
+	{ UE_LOG(LogTemp, Warning, TEXT("RealtimeMesh nullptr"));
+	return; }
+
+	const FRealtimeMeshSectionGroupKey GroupKey = FRealtimeMeshSectionGroupKey::Create(0, 0);
+	RealtimeMesh->UpdateSectionGroup(GroupKey, MoveTemp(StreamSet));
+
+	// road is made again if the new LOD has one.
+	ClearPathSpline(*ppRMA);
+
+	FRWScopeLock Lock(RWChunksMutex, FRWScopeLockType::SLT_Write);
+	ChunkLODs.Add(Chunk, LOD);
+}
+
+void ALandscapeManager::ClearPathSpline(ARealtimeMeshActor* pRMA)
+{
+	TArray<USplineMeshComponent*> SplineMeshes;
+	pRMA->GetComponents<USplineMeshComponent>(SplineMeshes);
+	for (auto& Elem : SplineMeshes) Elem->DestroyComponent();
+
+	TArray<USplineComponent*> Splines;
+	pRMA->GetComponents<USplineComponent>(Splines);
+	for (auto& Elem : Splines) Elem->DestroyComponent();
+}
+
+void ALandscapeManager::EmptyChunkPool()
+{
+	for (auto& Elem : ChunkPool)
+	{
+		if (IsValid(Elem)) Elem->Destroy();
+	}
+	ChunkPool.Empty();
+}
+
+// game thread. lands a finished horizon, asks for a new one once the truck is far from its center.
+void ALandscapeManager::UpdateHorizon(const FIntPoint& ChunkNow)
+{
+	FHorizonData HorizonData;
+	if (HorizonQueue.Dequeue(HorizonData))
+	{
+		if (ChunkScheduler) ChunkScheduler->Release(HorizonJobKey);
+		ApplyHorizon(MoveTemp(HorizonData));
+	}
+
+	if (!ChunkScheduler || ChunkScheduler->IsInFlight(HorizonJobKey)) return;
+
+	// streamed radius changed -> hole size changed too.
+	const int32 StreamRadius = ActiveChunkRadius;
+	if (IsHorizonMade && HorizonStreamRadius == StreamRadius
+		&& IsChunkInRad(HorizonCenter, ChunkNow, GetHorizonSlack(StreamRadius))) return;
+
+	// hole + drift before recentering stays inside the streamed chunks, so the horizon never shows through them.
+	int32 HoleRadius = StreamRadius - GetHorizonSlack(StreamRadius);
+	FIntPoint Center = ChunkNow;
+	// after the streamed chunks, it's only seen past them.
+	ChunkScheduler->Enqueue(HorizonJobKey, float(StreamRadius), [this, Center, HoleRadius, StreamRadius]() -> bool
+		{
+			const double StartTime = FPlatformTime::Seconds();
+
+			FHorizonData Out;
+			Out.Center = Center;
+			Out.StreamRadius = StreamRadius;
+			ChunkBuilder->GetHorizonStreamSet(Center, HoleRadius, Out.StreamSet);
+			Out.BuildMs = float((FPlatformTime::Seconds() - StartTime) * 1000.0);
+
+			this->HorizonQueue.Enqueue(MoveTemp(Out));
+			return true;
+		}
+	);
+}
+
+void ALandscapeManager::ApplyHorizon(FHorizonData&& HorizonData)
+{
+	const FRealtimeMeshSectionGroupKey GroupKey = FRealtimeMeshSectionGroupKey::Create(0, 0);
+	const FRealtimeMeshSectionKey PolyGroup0SectionKey = FRealtimeMeshSectionKey::CreateForPolyGroup(GroupKey, 0);
+
+	LastHorizonBuildMs = HorizonData.BuildMs;
+	SET_FLOAT_STAT(STAT_HorizonBuildMs, LastHorizonBuildMs);
+
+	FVector Offset = FVector(HorizonData.Center.X - HorizonChunks, HorizonData.Center.Y - HorizonChunks, 0.0f) * ChunkLength;
+
+	if (IsValid(HorizonActor))
+	{
+		URealtimeMeshSimple* RealtimeMesh = HorizonActor->GetRealtimeMeshComponent()->GetRealtimeMeshAs<URealtimeMeshSimple>();
+		if (!RealtimeMesh)
+		{ UE_LOG(LogTemp, Warning, TEXT("Horizon RealtimeMesh nullptr"));
+		return; }
+
+		RealtimeMesh->UpdateSectionGroup(GroupKey, MoveTemp(HorizonData.StreamSet));
+		HorizonActor->SetActorLocation(Offset);
+	}
+	else
+	{
+		UWorld* pWorld = GetWorld();
+		if (!pWorld)
+		{ UE_LOG(LogTemp, Warning, TEXT("GetWorld() nullptr"));
+		return; }
+
+		HorizonActor = pWorld->SpawnActor<ARealtimeMeshActor>();
+		if (!HorizonActor)
+		{ UE_LOG(LogTemp, Warning, TEXT("Horizon RMA nullptr"));
+		return; }
+
+		URealtimeMeshComponent* pRMC = HorizonActor->GetRealtimeMeshComponent();
+		URealtimeMeshSimple* RealtimeMesh = pRMC ? pRMC->InitializeRealtimeMesh<URealtimeMeshSimple>() : nullptr;
+		if (!RealtimeMesh)
+		{ UE_LOG(LogTemp, Warning, TEXT("Horizon RealtimeMesh nullptr"));
+		return; }
+
+		HorizonActor->GetRootComponent()->SetMobility(EComponentMobility::Movable);
+		HorizonActor->SetActorLocation(Offset);
+		HorizonActor->SetActorEnableCollision(false); // nothing drives out there.
+
+		RealtimeMesh->SetupMaterialSlot(0, "PrimaryMaterial");
+		RealtimeMesh->UpdateLODConfig(0, FRealtimeMeshLODConfig(1.00f));
+		RealtimeMesh->CreateSectionGroup(GroupKey, MoveTemp(HorizonData.StreamSet));
+		if (Material) pRMC->SetMaterial(0, Material);
+		RealtimeMesh->UpdateSectionConfig(PolyGroup0SectionKey, FRealtimeMeshSectionConfig(0), false);
+	}
+
+	HorizonCenter = HorizonData.Center;
+	HorizonStreamRadius = HorizonData.StreamRadius;
+	IsHorizonMade = true;
+}
+
+// chunks the truck can drift from HorizonCenter. at least one streamed ring is left for the hole.
+int32 ALandscapeManager::GetHorizonSlack(const int32& StreamRadius)
+{
+	return FMath::Clamp(HorizonRecenterChunks, 0, FMath::Max(StreamRadius - 1, 0));
+}
+
+void ALandscapeManager::RemoveHorizon()
+{
+	if (IsValid(HorizonActor)) HorizonActor->Destroy();
+	HorizonActor = nullptr;
+	IsHorizonMade = false;
+
+	// a finished job still holds its key. nothing else releases it.
+	FHorizonData HorizonData;
+	while (HorizonQueue.Dequeue(HorizonData))
+	{
+		if (ChunkScheduler) ChunkScheduler->Release(HorizonJobKey);
+	}
+}
+
 // Returns 2d index of whirl. Used for chunk generation from closest point.
 // Should be called only once in OnConstruction()
 void ALandscapeManager::GetChunkOrder(const int32& ChunkRad, TArray<FIntPoint>& OutArray)
@@ -437,10 +807,68 @@ void ALandscapeManager::GetChunkOrder(const int32& ChunkRad, TArray<FIntPoint>&
 	return;
 }
 
+// number of spiral entries that make radius. (2R+1)^2, capped by the order's size.
+int32 ALandscapeManager::GetOrderNum(const int32& Radius, const TArray<FIntPoint>& Order)
+{
+	return FMath::Min((Radius * 2 + 1) * (Radius * 2 + 1), Order.Num());
+}
+
+// game thread. one ring at a time, at most once per RadiusCooldown.
+// slow frames shrink it first, speed grows it back.
+void ALandscapeManager::UpdateChunkRadius(const float& DeltaTime)
+{
+	float FrameMs = DeltaTime * 1000.0f;
+	AverageFrameMs = (AverageFrameMs <= 0.0f) ? FrameMs : FMath::Lerp(AverageFrameMs, FrameMs, 0.05f);
+
+	RadiusChangeTime += DeltaTime;
+	if (RadiusChangeTime < RadiusCooldown) return;
+
+	FVector Velocity = GetPlayerVelocity();
+	float Speed = FVector2D(Velocity.X, Velocity.Y).Size();
+
+	int32 Radius = ActiveChunkRadius;
+	int32 Rings = Radius - ChunkRadius; // rings added for speed now. (can be < 0 after slow frames)
+	int32 NewRadius = Radius;
+
+	const bool IsFrameSlow = AverageFrameMs > TargetFrameMs * (1.0f + RadiusHysteresis);
+	const bool IsFrameFast = AverageFrameMs < TargetFrameMs * (1.0f - RadiusHysteresis);
+
+	if (IsFrameSlow)
+	{
+		NewRadius = Radius - 1;
+	}
+	// under ChunkRadius only because of slow frames. back toward it once they recover, even standing still.
+	else if (Rings < 0)
+	{
+		if (IsFrameFast) NewRadius = Radius + 1;
+	}
+	// speed only decides the rings above ChunkRadius.
+	else if (Speed > (Rings + 1) * SpeedPerRing * (1.0f + RadiusHysteresis) && IsFrameFast)
+	{
+		NewRadius = Radius + 1;
+	}
+	else if (Rings > 0 && Speed < Rings * SpeedPerRing * (1.0f - RadiusHysteresis))
+	{
+		NewRadius = Radius - 1;
+	}
+
+	NewRadius = FMath::Clamp(NewRadius, FMath::Min(MinChunkRadius, ChunkRadius), MaxChunkRadius);
+	if (NewRadius == Radius) return;
+
+	UE_LOG(LogTemp, Warning, TEXT("ChunkRadius %d -> %d (speed %f, frame %f ms)"), Radius, NewRadius, Speed, AverageFrameMs);
+	ActiveChunkRadius = NewRadius;
+	CurrentChunkRadius = NewRadius;
+	RadiusChangeTime = 0.0f;
+
+	// ask for a new build pass, same as moving to another chunk.
+	LastLocation = LastLocation + FIntPoint(-100, -100);
+}
+
 bool ALandscapeManager::IsChunkInRad(const FIntPoint& ChunkNow, const FIntPoint& TargetChunk)
 {
 	FIntPoint Dist = TargetChunk - ChunkNow;
-	return (FMath::Abs(Dist.X) <= ChunkRadius && FMath::Abs(Dist.Y) <= ChunkRadius);
+	int32 Radius = ActiveChunkRadius;
+	return (FMath::Abs(Dist.X) <= Radius && FMath::Abs(Dist.Y) <= Radius);
 }
 bool ALandscapeManager::IsChunkInRad(const FIntPoint& ChunkNow, const FIntPoint& TargetChunk, const int32& BoxRadius)
 {
@@ -519,6 +947,20 @@ void ALandscapeManager::MakeRoad(USplineComponent* Spline)
 }
 
 
+FVector ALandscapeManager::GetPlayerVelocity()
+{
+	UWorld* pWord = GetWorld();
+	APlayerController* pPlayerCon = nullptr;
+	APawn* pPlayerPawn = nullptr;
+	if (pWord) pPlayerCon = pWord->GetFirstPlayerController();
+	if (pPlayerCon) pPlayerPawn = pPlayerCon->GetPawn();
+
+	if (pPlayerPawn)
+		return pPlayerPawn->GetVelocity();
+	else
+		return FVector(0.f, 0.f, 0.f);
+}
+
 FVector ALandscapeManager::GetPlayerLocation()
 {
 	UWorld* pWord = GetWorld();
@@ -533,6 +975,7 @@ FVector ALandscapeManager::GetPlayerLocation()
 		return FVector(0.f, 0.f, 0.f);
 }
 
+// one gate pair per chunk. GetGatePath never enters a chunk twice, so nothing is overwritten.
 void ALandscapeManager::UpdateGateMap(const int32& StartIndex)
 {
 	for (int32 i = StartIndex; i < GatePath.Num() - 1; i++)
@@ -561,43 +1004,136 @@ void ALandscapeManager::UpdateDirMap(const int32& StartIndex)
 // async works below.
 
 
-// call it on game thread and it will do multithreading.
+// call it on game thread. only the pawn is read here, planning & builds run on ChunkScheduler workers.
+// jobs still in flight don't block it. they check themselves if they're still wanted.
 void ALandscapeManager::AsyncWork(const FIntPoint& ChunkNow)
 {
-	if (!ChunkQueue.IsEmpty()) return;
+	if (!ChunkScheduler) return;
+
+	FVector Location = GetPlayerLocation();
+	FVector Velocity = GetPlayerVelocity();
 
-	// make datas for it ( background thread )
-	AsyncTask(ENamedThreads::AnyBackgroundHiPriTask, [this, ChunkNow]()
+	// ahead of every build. it's what orders them.
+	bool Queued = ChunkScheduler->Enqueue(PlanJobKey, -MAX_flt, [this, ChunkNow, Location, Velocity]() -> bool
 		{
-			TMap<FIntPoint, TPair<FGate, FGate>> NearGatesMap;
-			TMap<FIntPoint, FVector2D> NearDirMap;
-			FindNearGates(ChunkNow, NearGatesMap, NearDirMap);
+			PlanChunks(ChunkNow, Location, Velocity);
+			return false; // nothing to hand back. frees PlanJobKey.
+		}
+	);
 
-			TArray<FIntPoint> ChunksNeeded;
-			FindChunksNeeded(ChunkNow, ChunksNeeded);
+	// last pass is still planning. try again in a few frames.
+	if (!Queued && ShouldWorkCounter == 0) ShouldWorkCounter = 1;
+}
 
-			this->UpdateDataQueue( ChunksNeeded, NearGatesMap, NearDirMap);
+// scheduler worker. gate & chunk maps are only locked while they're copied.
+void ALandscapeManager::PlanChunks(const FIntPoint& ChunkNow, const FVector& Location, const FVector& Velocity)
+{
+	TMap<FIntPoint, TPair<FGate, FGate>> NearGatesMap;
+	TMap<FIntPoint, FVector2D> NearDirMap;
+	FindNearGates(ChunkNow, NearGatesMap, NearDirMap);
 
-		}
-	);
+	TArray<TPair<float, FIntPoint>> ChunksNeeded;
+	TSet<FIntPoint> Prefetch;
+	FindChunksNeeded(ChunkNow, Location, Velocity, NearGatesMap, ChunksNeeded, Prefetch);
+
+	// new target set.
+	int32 Generation;
+	{
+		FScopeLock Lock(&BuildMutex);
+		BuildCenter = ChunkNow;
+		PrefetchChunks = MoveTemp(Prefetch);
+		Generation = BuildGeneration.Increment();
+	}
 
+	UpdateDataQueue(ChunkNow, ChunksNeeded, NearGatesMap, NearDirMap, Generation);
 }
 
-// game thread work.
+// game thread work. removes & adds chunks until IntegrationBudgetMs is used.
+// next item only starts if the measured average of its own kind still fits in what's left.
 void ALandscapeManager::Process(const FIntPoint& ChunkNow)
 {
-	// always remove first.
-	bool Removed = FindAndRemoveChunk(ChunkNow);
-	if(!Removed) DequeueAndAddChunk(ChunkNow);
+	SCOPE_CYCLE_COUNTER(STAT_ChunkIntegration);
+
+	const double StartTime = FPlatformTime::Seconds();
+	double UsedMs = 0.0;
+	int32 Items = 0;
+
+	// moving average. adapts to whatever the machine & chunk size costs.
+	auto Measure = [](float& Average, const double& Ms)
+	{
+		Average = (Average <= 0.0f) ? float(Ms) : FMath::Lerp(Average, float(Ms), 0.2f);
+	};
+
+	while (true)
+	{
+		// always remove first. peek which one is next, a cheap removal says nothing about an add.
+		FIntPoint Unwanted;
+		const bool IsRemoval = FindUnwantedChunk(ChunkNow, Unwanted);
+		if (!IsRemoval && ChunkQueue.IsEmpty()) break; // nothing to do
+
+		const float NextMs = IsRemoval ? AverageRemoveChunkMs : AverageAddChunkMs;
+		if (Items > 0 && UsedMs + NextMs > IntegrationBudgetMs) break;
+
+		const double ItemStart = FPlatformTime::Seconds();
+		if (IsRemoval)
+		{
+			RemoveChunk(Unwanted);
+			Measure(AverageRemoveChunkMs, (FPlatformTime::Seconds() - ItemStart) * 1000.0);
+		}
+		else if (DequeueAndAddChunk(ChunkNow))
+		{
+			Measure(AverageAddChunkMs, (FPlatformTime::Seconds() - ItemStart) * 1000.0);
+		}
+		else break; // queue only had results nobody wants anymore.
+
+		Items++;
+		UsedMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+	}
+
+	LastIntegrationMs = float(UsedMs);
+	LastIntegrationItems = Items;
+
+	SET_FLOAT_STAT(STAT_IntegrationBudgetMs, IntegrationBudgetMs);
+	SET_FLOAT_STAT(STAT_IntegrationUsedMs, LastIntegrationMs);
+	SET_FLOAT_STAT(STAT_AverageAddChunkMs, AverageAddChunkMs);
+	SET_FLOAT_STAT(STAT_AverageRemoveChunkMs, AverageRemoveChunkMs);
+	SET_DWORD_STAT(STAT_IntegratedItems, Items);
+	SET_DWORD_STAT(STAT_ChunkPoolHits, PoolHitCount);
+	SET_DWORD_STAT(STAT_ChunkPoolMisses, PoolMissCount);
+
+	LastChunkMeshKB = ChunkBuilder->LastChunkBytes / 1024.0f;
+	LastChunkSavedKB = ChunkBuilder->LastChunkSavedBytes / 1024.0f;
+	SET_FLOAT_STAT(STAT_ChunkMeshKB, LastChunkMeshKB);
+	SET_FLOAT_STAT(STAT_ChunkLayoutSavedKB, LastChunkSavedKB);
+
+	if (ChunkDataCache)
+	{
+		int32 Hits = ChunkDataCache->GetHitCount();
+		int32 Lookups = Hits + ChunkDataCache->GetMissCount();
+		ChunkDataCacheHitRate = (Lookups > 0) ? 100.0f * Hits / Lookups : 0.0f;
+		SIZE_T CacheBytes = ChunkDataCache->GetBytes();
+		ChunkDataCacheMB = CacheBytes / (1024.0f * 1024.0f);
+		SET_FLOAT_STAT(STAT_ChunkDataCacheHitRate, ChunkDataCacheHitRate);
+		SET_MEMORY_STAT(STAT_ChunkDataCacheMemory, CacheBytes);
+	}
+
+	if (ChunkDiskCache)
+	{
+		int32 Hits = ChunkDiskCache->GetHitCount();
+		int32 Lookups = Hits + ChunkDiskCache->GetMissCount();
+		DiskCacheHitRate = (Lookups > 0) ? 100.0f * Hits / Lookups : 0.0f;
+		DiskCacheMB = ChunkDiskCache->GetBytes() / (1024.0f * 1024.0f);
+		SET_FLOAT_STAT(STAT_ChunkDiskCacheHitRate, DiskCacheHitRate);
+	}
 }
 
-bool ALandscapeManager::FindAndRemoveChunk(const FIntPoint& ChunkNow)
+bool ALandscapeManager::FindUnwantedChunk(const FIntPoint& ChunkNow, FIntPoint& OutChunk)
 {
 	for (auto& Elem : Chunks)
 	{
-		if (!IsChunkInRad(ChunkNow, Elem.Key))
+		if (!IsChunkWanted(ChunkNow, Elem.Key))
 		{
-			RemoveChunk(Elem.Key);
+			OutChunk = Elem.Key;
 			return true;
 		}
 	}
@@ -607,18 +1143,37 @@ bool ALandscapeManager::FindAndRemoveChunk(const FIntPoint& ChunkNow)
 
 bool ALandscapeManager::DequeueAndAddChunk(const FIntPoint& ChunkNow)
 {
+	LLM_SCOPE_BYNAME(TEXT("RoadTrain/ChunkIntegration"));
 
 	while (!ChunkQueue.IsEmpty())
 	{
 		FChunkData ChunkData;
 		ChunkQueue.Dequeue(ChunkData);
 		const FIntPoint& Chunk = ChunkData.Chunk;
-		const RealtimeMesh::FRealtimeMeshStreamSet& StreamSet = ChunkData.StreamSet;
-		const TArray<FVector> Path = ChunkData.ActualPath;
+		if (ChunkScheduler) ChunkScheduler->Release(Chunk);
+		const TArray<FVector>& Path = ChunkData.ActualPath;
+
+		if (!IsChunkWanted(ChunkNow, Chunk)) continue;
+
+		// built for a ring we already left. dropped, the next pass asks for the right LOD.
+		if (ChunkData.LOD != GetChunkLOD(ChunkNow, Chunk))
+		{
+			if (ShouldWorkCounter == 0) ShouldWorkCounter = 1;
+			continue;
+		}
+
+		if (!Chunks.Contains(Chunk))
+		{
+			AddChunk(Chunk, MoveTemp(ChunkData.StreamSet), ChunkData.LOD);
+			if (!Path.IsEmpty()) AddPathSpline(Chunk, Path);
+			return true;
+		}
 
-		if (!Chunks.Contains(Chunk) && IsChunkInRad(ChunkNow, Chunk))
+		// crossed a ring boundary. only this chunk's mesh is swapped.
+		const int32* FoundLOD = ChunkLODs.Find(Chunk);
+		if (!FoundLOD || *FoundLOD != ChunkData.LOD)
 		{
-			AddChunk(Chunk, StreamSet);
+			UpdateChunk(Chunk, MoveTemp(ChunkData.StreamSet), ChunkData.LOD);
 			if (!Path.IsEmpty()) AddPathSpline(Chunk, Path);
 			return true;
 		}
@@ -628,65 +1183,123 @@ bool ALandscapeManager::DequeueAndAddChunk(const FIntPoint& ChunkNow)
 }
 
 
-void ALandscapeManager::UpdateDataQueue(const TArray<FIntPoint> ChunksNeeded, const TMap<FIntPoint, TPair<FGate, FGate>> NearGatesMap, const TMap<FIntPoint, FVector2D> NearDirMap)
+// one scheduler job per chunk, queued by its priority. chunks already in flight are skipped by the scheduler.
+// runs on the planning job, so cache hits are packed right here and never scheduled.
+void ALandscapeManager::UpdateDataQueue(const FIntPoint& ChunkNow, const TArray<TPair<float, FIntPoint>>& ChunksNeeded, const TMap<FIntPoint, TPair<FGate, FGate>>& NearGatesMap, const TMap<FIntPoint, FVector2D>& NearDirMap, const int32& Generation)
 {
+	for (auto& Needed : ChunksNeeded)
+	{
+		const FIntPoint& Chunk = Needed.Value;
+		// find gates belong to neighbor chunks.
+		TArray<TPair<FGate, FGate>> NearGates;
+		TArray<FVector2D> NearDir;
+		for (int32 j = -1; j <= 1; j++)
+			for (int32 i = -1; i <= 1; i++)
+			{
+				FIntPoint TargetChunk = Chunk + FIntPoint(i, j);
+				const TPair<FGate, FGate>* FoundGates = NearGatesMap.Find(TargetChunk);
+				const FVector2D* FoundDir = NearDirMap.Find(TargetChunk);
+				FVector2D Dir = FVector2D::ZeroVector;
+				if (FoundGates)
+				{
+					NearGates.Add((*FoundGates));
 
-	ParallelFor(ChunksNeeded.Num(), [ChunksNeeded, NearGatesMap, NearDirMap, this](int32 Index)
-		{ // lambda body
+					if (FoundDir) Dir = *FoundDir;
+					NearDir.Add(Dir);
+				}
 
-			FIntPoint Chunk = ChunksNeeded[Index];
+			}
 
-			// find gates belong to neighbor chunks.
-			TArray<TPair<FGate, FGate>> NearGates;
-			TArray<FVector2D> NearDir;
-			for (int32 j = -1; j <= 1; j++)
-				for (int32 i = -1; i <= 1; i++)
-				{
-					FIntPoint TargetChunk = Chunk + FIntPoint(i, j);
-					const TPair<FGate, FGate>* FoundGates = NearGatesMap.Find(TargetChunk);
-					const FVector2D* FoundDir = NearDirMap.Find(TargetChunk);
-					FVector2D Dir = FVector2D::ZeroVector;
-					if (FoundGates)
-					{
-						NearGates.Add((*FoundGates));
-
-						if (FoundDir) Dir = *FoundDir;
-						NearDir.Add(Dir);
-					}
-					
-				}
+		int32 LOD = GetChunkLOD(ChunkNow, Chunk);
+		if (ChunkScheduler->IsInFlight(Chunk)) continue;
 
-			this->ChunkQueue.Enqueue( MakeChunkData(Chunk, NearGates, NearDir) );
+		FChunkDataKey Key(Chunk, LOD, GetPathVersion(NearGates, NearDir, LOD));
 
+		// built before with the same roads. the only copy is this packing, and only on a hit.
+		FCachedChunkPtr Cached = ChunkDataCache ? ChunkDataCache->Find(Key) : nullptr;
+		if (Cached)
+		{
+			if (!ChunkScheduler->TryReserve(Chunk)) continue;
+
+			RealtimeMesh::FRealtimeMeshStreamSet StreamSet;
+			int32 MeshBytes = ChunkBuilder->GetStreamSet(Cached->GetView(), StreamSet);
+			FChunkData Data(Chunk, MoveTemp(StreamSet), TArray<FVector>(Cached->ActualPath), LOD);
+			Data.MeshBytes = MeshBytes;
+			this->ChunkQueue.Enqueue(MoveTemp(Data));
+			continue;
 		}
-	);
+
+		ChunkScheduler->Enqueue(Chunk, Needed.Key, [this, Chunk, NearGates = MoveTemp(NearGates), NearDir = MoveTemp(NearDir), Generation, LOD, Key]() -> bool
+			{
+				// build allocations show up under this tag with -llm.
+				LLM_SCOPE_BYNAME(TEXT("RoadTrain/ChunkBuild"));
+
+				// truck moved on. drop it before paths & meshing.
+				if (IsBuildStale(Chunk, Generation))
+				{
+					INC_DWORD_STAT(STAT_DroppedChunkBuilds);
+					return false;
+				}
+
+				// saved on an earlier launch (or drive). no noise, paths or meshing.
+				// either way the memory cache gets the raw arrays, the stream set itself is moved to the queue.
+				FChunkData Data;
+				if (!ChunkDiskCache || !ChunkDiskCache->Load(Key, *ChunkBuilder, Data, ChunkDataCache.get())) Data = MakeChunkData(Key, NearGates, NearDir);
+				this->ChunkQueue.Enqueue(MoveTemp(Data));
+				return true;
+			}
+		);
+	}
 
 }
 
 
-FChunkData ALandscapeManager::MakeChunkData(const FIntPoint TargetChunk, const TArray< TPair<FGate, FGate> > NearGates, const TArray<FVector2D> NearDir)
+// roads only on LOD 0. far chunks skip pathfinding altogether.
+FChunkData ALandscapeManager::MakeChunkData(const FChunkDataKey& Key, const TArray< TPair<FGate, FGate> >& NearGates, const TArray<FVector2D>& NearDir)
 {
+	const FIntPoint& TargetChunk = Key.Chunk;
+	const int32& LOD = Key.LOD;
 
 	TArray<FVector> Paths;
 	TArray<FVector> PathForSpline;
-	for (int32 i = 0; i< NearGates.Num(); i++)
+	for (int32 i = 0; i < NearGates.Num() && LOD == 0; i++)
 	{
 		const TPair<FGate, FGate>& Elem = NearGates[i];
-		const FVector2D LastDir = NearDir[i];
+		const FVector2D& LastDir = NearDir[i];
 
 		TArray<FVector> TempPath;
 		PathFinder->GetActualPath(Elem.Key, Elem.Value, TempPath, LastDir);
 		Paths.Append(TempPath);
 
-		if (GetChunk(Elem.Key.B) == TargetChunk) PathForSpline = TempPath;
+		if (GetChunk(Elem.Key.B) == TargetChunk) PathForSpline = MoveTemp(TempPath);
 	}
 
 	RealtimeMesh::FRealtimeMeshStreamSet StreamSet;
-	ChunkBuilder->GetStreamSet(TargetChunk, Paths, StreamSet);
-	FChunkData Out(TargetChunk, StreamSet, PathForSpline);
+	FChunkMeshView Mesh;
+	int32 MeshBytes = ChunkBuilder->GetStreamSet(TargetChunk, Paths, StreamSet, LOD, &Mesh);
+	// Mesh points into the builder's scratch, save it before the next build.
+	if (ChunkDiskCache) ChunkDiskCache->Save(Key, Mesh, PathForSpline);
+	if (ChunkDataCache) ChunkDataCache->Add(Key, Mesh, PathForSpline);
+	FChunkData Out(TargetChunk, MoveTemp(StreamSet), MoveTemp(PathForSpline), LOD);
+	Out.MeshBytes = MeshBytes;
 	return Out;
 }
 
+// what MakeChunkData's roads depend on. LOD > 0 has no roads, so any version is the same.
+uint32 ALandscapeManager::GetPathVersion(const TArray< TPair<FGate, FGate> >& NearGates, const TArray<FVector2D>& NearDir, const int32& LOD)
+{
+	if (LOD != 0) return 0;
+
+	uint32 Hash = GetTypeHash(NearGates.Num());
+	for (int32 i = 0; i < NearGates.Num(); i++)
+	{
+		Hash = HashCombine(Hash, GetTypeHash(NearGates[i].Key));
+		Hash = HashCombine(Hash, GetTypeHash(NearGates[i].Value));
+		Hash = HashCombine(Hash, GetTypeHash(NearDir[i]));
+	}
+	return Hash;
+}
+
 
 // finds gates that are in BigChunkOrder radius.
 void ALandscapeManager::FindNearGates(const FIntPoint& ChunkNow, TMap<FIntPoint, TPair<FGate, FGate>>& OutGatesMap, TMap<FIntPoint, FVector2D>& OutDirMap)
@@ -694,8 +1307,10 @@ void ALandscapeManager::FindNearGates(const FIntPoint& ChunkNow, TMap<FIntPoint,
 	OutGatesMap.Empty();
 
 	FRWScopeLock Lock(RWGatesMutex, FRWScopeLockType::SLT_ReadOnly);
-	for (auto& Elem : this->BigChunkOrder)
+	int32 OrderNum = GetOrderNum(ActiveChunkRadius + MaxPrefetchChunks + 1, BigChunkOrder);
+	for (int32 i = 0; i < OrderNum; i++)
 	{
+		const FIntPoint& Elem = BigChunkOrder[i];
 		FIntPoint TargetChunk = Elem + ChunkNow;
 		TPair<FGate, FGate>* FoundGates = this->GateMap.Find(TargetChunk);
 		FVector2D* FoundDir = nullptr;
@@ -708,37 +1323,87 @@ void ALandscapeManager::FindNearGates(const FIntPoint& ChunkNow, TMap<FIntPoint,
 	}
 }
 
-void ALandscapeManager::FindChunksNeeded(const FIntPoint& ChunkNow, TArray<FIntPoint>& OutChunksNeeded)
+// chunks to build with their priority, most wanted (lowest) first. ChunkRadius + chunks ahead as speed rises.
+// thread safe. NearGatesMap is FindNearGates's copy, OutPrefetch is what's wanted past ChunkRadius.
+void ALandscapeManager::FindChunksNeeded(const FIntPoint& ChunkNow, const FVector& Location, const FVector& Velocity, const TMap<FIntPoint, TPair<FGate, FGate>>& NearGatesMap, TArray<TPair<float, FIntPoint>>& OutChunksNeeded, TSet<FIntPoint>& OutPrefetch)
 {
 	OutChunksNeeded.Empty();
-	TQueue<FIntPoint, EQueueMode::Mpsc> TempQueue;
+	OutPrefetch.Empty();
 
-	{// scopelock read
-		FRWScopeLock Lock(RWChunksMutex, FRWScopeLockType::SLT_ReadOnly);
+	FVector2D Heading = FVector2D(Velocity.X, Velocity.Y).GetSafeNormal();
 
-		ParallelFor(ChunkOrder.Num(), [&TempQueue, ChunkNow, this](int32 Index)
-			{
-				FIntPoint Target = this->ChunkOrder[Index] + ChunkNow;
-				if (!Chunks.Contains(Target)) TempQueue.Enqueue(Target);
-			}
-		);
+	// chunks we'll cover in PrefetchSeconds. heading counts fully once that's a whole chunk.
+	float Ahead = FVector2D(Velocity.X, Velocity.Y).Size() * PrefetchSeconds / ChunkLength;
+	int32 PrefetchRadius = FMath::Clamp(FMath::FloorToInt32(Ahead), 0, MaxPrefetchChunks);
+	float HeadingFactor = FMath::Clamp(Ahead, 0.f, 1.f);
+	const float PrefetchAlignment = 0.5f; // cos 60. only prefetch what's in front.
+
+	int32 Radius = ActiveChunkRadius;
+	int32 OrderNum = GetOrderNum(Radius + PrefetchRadius, BigChunkOrder);
 
+	// every chunk in Chunks has an LOD here.
+	TMap<FIntPoint, int32> BuiltLODs;
+	{
+		FRWScopeLock Lock(RWChunksMutex, FRWScopeLockType::SLT_ReadOnly);
+		BuiltLODs = ChunkLODs;
 	}
 
-	while (!TempQueue.IsEmpty())
+	for (int32 i = 0; i < OrderNum; i++)
 	{
-		FIntPoint Target;
-		TempQueue.Dequeue(Target);
-		OutChunksNeeded.Add(Target);
+		const FIntPoint& Elem = BigChunkOrder[i];
+		FIntPoint Target = Elem + ChunkNow;
+		FVector2D ToChunk = FVector2D(Target.X + 0.5f, Target.Y + 0.5f) * ChunkLength - FVector2D(Location.X, Location.Y);
+		float Alignment = FVector2D::DotProduct(ToChunk.GetSafeNormal(), Heading);
+
+		if (!IsChunkInRad(ChunkNow, Target))
+		{
+			if (!IsChunkInRad(ChunkNow, Target, Radius + PrefetchRadius) || Alignment < PrefetchAlignment) continue;
+			OutPrefetch.Add(Target);
+		}
+		// already there with the right LOD. inner rings never come back here on a ring change.
+		const int32* FoundLOD = BuiltLODs.Find(Target);
+		if (FoundLOD && *FoundLOD == GetChunkLOD(ChunkNow, Target)) continue;
+
+		float Priority = ToChunk.Size() / ChunkLength - Alignment * HeadingFactor * HeadingWeight;
+		if (NearGatesMap.Contains(Target)) Priority -= GatePathWeight;
+		OutChunksNeeded.Add(TPair<float, FIntPoint>(Priority, Target));
 	}
+
+	OutChunksNeeded.StableSort([](const TPair<float, FIntPoint>& A, const TPair<float, FIntPoint>& B) { return A.Key < B.Key; });
 }
 
+// thread safe. 0 inside FullDetailRadius, one level up every LODRingWidth rings after it.
+int32 ALandscapeManager::GetChunkLOD(const FIntPoint& ChunkNow, const FIntPoint& Chunk)
+{
+	if (MaxChunkLOD <= 0) return 0;
 
-bool ALandscapeManager::ShouldDoWork(const FIntPoint& ChunkNow)
+	int32 Dist = FMath::Max(FMath::Abs(Chunk.X - ChunkNow.X), FMath::Abs(Chunk.Y - ChunkNow.Y));
+	if (Dist <= FullDetailRadius) return 0;
+	return FMath::Min(1 + (Dist - FullDetailRadius - 1) / FMath::Max(LODRingWidth, 1), MaxChunkLOD);
+}
+
+// thread safe. job is stale if the target set moved on without its chunk.
+bool ALandscapeManager::IsBuildStale(const FIntPoint& Chunk, const int32& Generation)
 {
-	if (!ChunkQueue.IsEmpty()) return false;
+	if (Generation == BuildGeneration.GetValue()) return false;
 
-	if (LastLocation != ChunkNow) // loc changed and queue empty
+	FScopeLock Lock(&BuildMutex);
+	return !IsChunkInRad(BuildCenter, Chunk) && !PrefetchChunks.Contains(Chunk);
+}
+
+// thread safe. in radius, or prefetched ahead.
+bool ALandscapeManager::IsChunkWanted(const FIntPoint& ChunkNow, const FIntPoint& Chunk)
+{
+	if (IsChunkInRad(ChunkNow, Chunk)) return true;
+
+	FScopeLock Lock(&BuildMutex);
+	return PrefetchChunks.Contains(Chunk);
+}
+
+
+bool ALandscapeManager::ShouldDoWork(const FIntPoint& ChunkNow)
+{
+	if (LastLocation != ChunkNow) // loc changed
 	{
 		LastLocation = ChunkNow;
 		ShouldWorkCounter = 1;
@@ -757,101 +1422,120 @@ bool ALandscapeManager::ShouldDoWork(const FIntPoint& ChunkNow)
 }
 
 
-// Infinite pathfinding. maybe we should use a dedicated thread.
+// Infinite pathfinding. searches run on PathService.
 // do one way first.
 
 
 void ALandscapeManager::TryUpdatingGoal(const FIntPoint& ChunkNow)
 {
+	// one extension at a time. the next one starts from where this one ends.
+	if (GoalJob && !GoalJob->Done) return;
+	GoalJob.Reset();
 
 	if (ShouldUpdateGoal(ChunkNow))
 	{
 		UE_LOG(LogTemp, Warning, TEXT("Attempting to Update Goal"));
 		UpdateGoal();
 	}
-	if (UpdatedGoal)
-	{
-		UE_LOG(LogTemp, Warning, TEXT("Goal Updated!"));
-		PathWorker.reset();
-		UpdatedGoal = false;
-	}
 
 }
 
-bool ALandscapeManager::ShouldUpdateGoal(const FIntPoint& ChunkNow)
+// game thread. before GatePath is rebuilt, an extension of the old one mustn't land on the new one.
+void ALandscapeManager::CancelGoalUpdate()
 {
-	return IsChunkInRad(ChunkNow, GetChunk(End), ChunkRadius * 2);
+	if (GoalJob) GoalJob->Cancelled = true;
+	GoalJob.Reset();
+	GatePathVersion++;
 }
 
-void ALandscapeManager::UpdateGoal()
-{
-	PathWorker = std::make_unique<FPathWorker>(this);
-}
-
-
-// --------------pathworker.
-
-bool FPathWorker::Init()
+bool ALandscapeManager::ShouldUpdateGoal(const FIntPoint& ChunkNow)
 {
-	if (!pLM) return false;
-
-	if (pLM->GatePath.Num() - 2 < 0) return false;
-
-	// Last one is goal, so -1. Last gate is our start.
-	this->Start = pLM->GatePath[pLM->GatePath.Num() - 2].B; 
-
-	// just add some value to current End.
-	this->End = pLM->GatePath.Last().A + FIntPoint(pLM->ChunkRadius * 2 * (pLM->VerticesPerChunk - 1), 0);
-
-	return true;
+	return IsChunkInRad(ChunkNow, GetChunk(End), ChunkRadius * 2);
 }
 
-uint32 FPathWorker::Run()
+struct FGoalUpdate
 {
+	int32 GatePathVersion = 0;	// GatePathVersion the search started from.
+	FIntPoint End;
 	TArray<FGate> NewGatePath;
-	bool Success = pLM->PathFinder->GetGatePath(Start, End, NewGatePath);
-	if (!Success)
-	{
-		UE_LOG(LogTemp, Error, TEXT("INF Path Calc Error. Abort"));
-		return 0;
-	}
+	TArray<TPair<FIntPoint, FVector2D>> NewDirs;	// GateLastDir entries of the new gates.
+};
 
-	
-	{	// scopelock
-
-		FRWScopeLock Lock(pLM->RWGatesMutex, FRWScopeLockType::SLT_Write);
-
-		int32 LastIndex = pLM->GatePath.Num() - 1;
-		// remove last element. (goal).
-		pLM->GatePath.RemoveAt(LastIndex--);
-		// set first. (gate to prev goal chunk).
-		NewGatePath[0] = pLM->GatePath.Last();
-		// remove last element. ( gate to prev goal chunk )
-		pLM->GatePath.RemoveAt(LastIndex--);
-		pLM->GatePath.Append(NewGatePath);
-		pLM->End = this->End;
-		pLM->UpdateGateMap(LastIndex);
-		pLM->UpdateDirMap(LastIndex);
+// search & actual paths on the path service. game thread only splices GatePath & fills the maps.
+void ALandscapeManager::UpdateGoal()
+{
+	if (!PathService) return;
 
-	}	// scopelock
+	const int32 Version = GatePathVersion;
+	GoalJob = PathService->Enqueue<FGoalUpdate>(EPathJobPriority::High,
+		[this, Version](const FPathJobState& State, FGoalUpdate& Out) -> bool
+		{
+			Out.GatePathVersion = Version;
+			FIntPoint GoalStart;
+			TSet<FIntPoint> UsedChunks;
+			FGate PrevGate, GoalGate;
+			FVector2D PrevDir = FVector2D::ZeroVector;
+			{
+				FRWScopeLock Lock(RWGatesMutex, FRWScopeLockType::SLT_ReadOnly);
+				// gate before the goal chunk's is where the splice starts.
+				if (GatePath.Num() < 3) return false;
+
+				// Last one is goal, so -1. Last gate is our start.
+				GoalStart = GatePath[GatePath.Num() - 2].B;
+				GoalGate = GatePath[GatePath.Num() - 2];
+				PrevGate = GatePath[GatePath.Num() - 3];
+				const FVector2D* FoundDir = GateLastDir.Find(GetChunk(PrevGate.B));
+				if (FoundDir) PrevDir = *FoundDir;
+				// chunks behind the goal chunk already have their gate pair.
+				for (int32 i = 0; i < GatePath.Num() - 2; i++) UsedChunks.Add(GetChunk(GatePath[i].B));
+				// just add some value to current End.
+				Out.End = GatePath.Last().A + FIntPoint(ChunkRadius * 2 * (VerticesPerChunk - 1), 0);
+			}
 
+			bool Success = PathFinder->GetGatePath(GoalStart, Out.End, Out.NewGatePath, &State.Cancelled, &UsedChunks);
+			if (!Success && !State.Cancelled) UE_LOG(LogTemp, Error, TEXT("INF Path Calc Error. Abort"));
+			if (!Success || Out.NewGatePath.Num() == 0) return false;
 
-	return uint32(0); // success
-}
+			// what UpdateDirMap does from the splice on. also warms the ActualPath cache for the chunk builds.
+			// chunks aren't entered twice, so each one's direction is the one made just before it.
+			Out.NewGatePath[0] = GoalGate;
+			FVector2D Direction = PrevDir;
+			FGate From = PrevGate;
+			for (const FGate& To : Out.NewGatePath)
+			{
+				if (State.Cancelled) return false;
 
-void FPathWorker::Exit()
-{
-	pLM->UpdatedGoal = true;
-	UE_LOG(LogTemp, Warning, TEXT("Updating goal calculation background task done!!"));
-}
+				TArray<FVector> TempPath;
+				Direction = PathFinder->GetActualPath(From, To, TempPath, Direction);
+				Out.NewDirs.Add(TPair<FIntPoint, FVector2D>(GetChunk(To.B), Direction));
+				From = To;
+			}
+			return true;
+		},
+		[this](FGoalUpdate&& Update)
+		{
+			FRWScopeLock Lock(RWGatesMutex, FRWScopeLockType::SLT_Write);
 
-FPathWorker::~FPathWorker()
-{
-	if (Thread)
-	{
-		Thread->Kill(true);
-		delete Thread;
-		Thread = nullptr;
-	}
+			// GatePath was remade while searching. (GenerateLandscapeWithPath) its job should've been cancelled, this is the backup.
+			if (GatePathVersion != Update.GatePathVersion)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("Goal update is stale, dropped"));
+				return;
+			}
 
+			int32 LastIndex = GatePath.Num() - 1;
+			// remove last element. (goal).
+			GatePath.RemoveAt(LastIndex--);
+			// set first. (gate to prev goal chunk).
+			Update.NewGatePath[0] = GatePath.Last();
+			// remove last element. ( gate to prev goal chunk )
+			GatePath.RemoveAt(LastIndex--);
+			GatePath.Append(MoveTemp(Update.NewGatePath));
+			End = Update.End;
+			UpdateGateMap(LastIndex);
+			for (auto& Elem : Update.NewDirs) GateLastDir.Add(Elem.Key, Elem.Value);
+
+			UE_LOG(LogTemp, Warning, TEXT("Goal Updated!"));
+		}
+	);
 }
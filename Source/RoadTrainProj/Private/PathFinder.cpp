@@ -1,8 +1,13 @@
 
 #include "PathFinder.h"
 #include "LandscapeManager.h"
+#include "HeightCache.h"
 #include "DrawDebugHelpers.h"
 
+#include "Math/VectorRegister.h" // cost grid
+#include "Async/ParallelFor.h"   // chunk graph
+#include "HAL/ThreadSingleton.h" // search scratch
+
 #include <limits>
 const float INFLOAT = std::numeric_limits<float>::infinity(); // float INF for obstacles
 const float SQRT2 = FMath::Sqrt(2.0f);
@@ -14,6 +19,20 @@ FPathFinder::FPathFinder( ALandscapeManager* pLM ) : pLM( pLM )
 	SlopeViolationPanelty = pLM->SlopeViolationPanelty;
 	MinTurnRadius = pLM->MinTurnRadius;
 	UnitMinTurnRadius = MinTurnRadius / pLM->VertexSpacing;
+	EntrancesPerEdge = pLM->EntrancesPerEdge;
+
+	// budget -> number of grids. every grid has the same size.
+	int32 CellNum = pLM->VerticesPerChunk - 1;
+	SIZE_T GridBytes = sizeof(FCostGrid) + SIZE_T(FMath::Square(CellNum)) * (8 * sizeof(float) + sizeof(uint8));
+	SIZE_T Budget = SIZE_T(FMath::Max(pLM->CostGridBudgetMB, 1)) * 1024 * 1024;
+	CostGrids.Empty(FMath::Max(int32(Budget / GridBytes), 9));
+
+	// chunk graphs are a few hundred bytes each. keep way more of them than grids.
+	ChunkGraphs.Empty(CostGrids.Max() * 16);
+
+	ActualPaths.Empty(FMath::Max(pLM->PathCacheSize, 16));
+	PathHitCount = 0;
+	PathMissCount = 0;
 }
 
 // temporary struct for pathfinding.
@@ -23,84 +42,259 @@ struct FNode
 		GCost = INFLOAT;
 		FCost = INFLOAT;
 		CameFrom = NoConnection;
-		IsOpen = false;
-		Prev = NoConnection;
-		Next = NoConnection;
 	};
 
 	FNode(
 		const float& GCost,
 		const float& FCost,
-		const FIntPoint& CameFrom,
-		const bool& IsOpen,
-		const FIntPoint& Prev,
-		const FIntPoint& Next
-	) : GCost(GCost), FCost(FCost), CameFrom(CameFrom), IsOpen(IsOpen), Prev(Prev), Next(Next) {
+		const FIntPoint& CameFrom
+	) : GCost(GCost), FCost(FCost), CameFrom(CameFrom) {
 	};
 
 	// f(n) = g(n) + h(n) -> final cost = cost + heuristic
 	float GCost; // g(n). cost total to this point.
 	float FCost; // f(n). g(n) + h(n).
 	FIntPoint CameFrom;
-	bool IsOpen;
-	FIntPoint Prev; // open list doubly linked
-	FIntPoint Next;
 };
 
-// Chunk Level A*. use GetGates to find neighbors.
-// basically GetPath on Chunk Level.
-// StartCell & EndCell == GlobalGrid.
-bool FPathFinder::GetGatePath(const FIntPoint& StartCell, const FIntPoint& EndCell, TArray<FGate>& OutGatePath)
+// open list for A*. binary heap on FCost, keyed by flat index (decrease-key by index).
+// ties go to the node that was opened first, same as scanning the old linked open list.
+// grows if index goes past NodeNum. (gate search doesn't know its node count)
+struct FOpenList
 {
-	
-	// +2 to make box size like below.
-	// 0 0 0 0
-	// 0 0 e 0
-	// 0 s 0 0
-	// 0 0 0 0
-	// one chunk bigger.
-	// S and E should be in 0 ~ + Range.
-	// so we'll add offset.
+	FOpenList() {};
+	FOpenList(const int32& NodeNum)
+	{
+		Reset(NodeNum);
+	};
 
-	FIntPoint StartChunk = GetChunk(StartCell);
-	FIntPoint EndChunk = GetChunk(EndCell);
+	// empty, NodeNum nodes. keeps memory.
+	void Reset(const int32& NodeNum)
+	{
+		Heap.Reset();
+		HeapPos.Reset();
+		HeapPos.SetNumUninitialized(NodeNum);
+		for (int32& Elem : HeapPos) Elem = INDEX_NONE;
+		NextOrder = 0;
+	}
+
+	bool IsEmpty() const { return Heap.IsEmpty(); }
+	bool Contains(const int32& FlatIndex) const { return HeapPos.IsValidIndex(FlatIndex) && HeapPos[FlatIndex] != INDEX_NONE; }
+
+	// opens node, or updates its cost if it's already open.
+	void Push(const int32& FlatIndex, const float& FCost)
+	{
+		while (HeapPos.Num() <= FlatIndex) HeapPos.Add(INDEX_NONE);
+
+		int32 Pos = HeapPos[FlatIndex];
+		if (Pos == INDEX_NONE)
+		{
+			Pos = Heap.Add(FEntry{ FCost, NextOrder++, FlatIndex });
+			HeapPos[FlatIndex] = Pos;
+			SiftUp(Pos);
+			return;
+		}
 
-	FIntPoint Offset = FIntPoint( -FMath::Min(StartChunk.X, EndChunk.X), -FMath::Min(StartChunk.Y, EndChunk.Y) ) + FIntPoint(1, 1);
+		// already open. keep the order it was opened in.
+		float OldCost = Heap[Pos].FCost;
+		Heap[Pos].FCost = FCost;
+		if (FCost < OldCost) SiftUp(Pos);
+		else SiftDown(Pos);
+	}
 
-	FIntPoint Start = StartChunk + Offset;
-	FIntPoint End = EndChunk + Offset;
+	// removes and returns lowest FCost node.
+	int32 Pop()
+	{
+		int32 Out = Heap[0].Index;
+		HeapPos[Out] = INDEX_NONE;
 
-	FIntPoint FrontierSize( FMath::Abs(Start.X - End.X) + 1 + 2, FMath::Abs(Start.Y - End.Y) + 1 + 2 ); // may be rectangle
-	// made the box.
+		FEntry Last = Heap.Pop(EAllowShrinking::No);
+		if (!Heap.IsEmpty())
+		{
+			Heap[0] = Last;
+			HeapPos[Last.Index] = 0;
+			SiftDown(0);
+		}
+		return Out;
+	}
 
-	if (FrontierSize.X * FrontierSize.Y > 500 * 500)
+private:
+	struct FEntry
 	{
-		UE_LOG(LogTemp, Warning, TEXT("Start-End box too big."));
-		return false;
+		float FCost;
+		uint32 Order; // opened order. tie breaker.
+		int32 Index;
+	};
+
+	TArray<FEntry> Heap;
+	TArray<int32> HeapPos; // flat index -> position in heap. INDEX_NONE if not open.
+	uint32 NextOrder = 0;
+
+	static bool IsLess(const FEntry& A, const FEntry& B)
+	{
+		return A.FCost < B.FCost || (A.FCost == B.FCost && A.Order < B.Order);
 	}
 
-	TArray<FNode> Frontier;
-	int32 FrontierNum = FrontierSize.X * FrontierSize.Y;
-	int32 RowNum = FrontierSize.X;
-	Frontier.SetNum(FrontierNum);
+	void Swap(const int32& A, const int32& B)
+	{
+		Heap.Swap(A, B);
+		HeapPos[Heap[A].Index] = A;
+		HeapPos[Heap[B].Index] = B;
+	}
 
+	void SiftUp(int32 Pos)
+	{
+		while (Pos > 0)
+		{
+			int32 Parent = (Pos - 1) / 2;
+			if (!IsLess(Heap[Pos], Heap[Parent])) break;
+			Swap(Pos, Parent);
+			Pos = Parent;
+		}
+	}
+
+	void SiftDown(int32 Pos)
+	{
+		while (true)
+		{
+			int32 Left = Pos * 2 + 1;
+			int32 Right = Left + 1;
+			int32 Smallest = Pos;
+			if (Left < Heap.Num() && IsLess(Heap[Left], Heap[Smallest])) Smallest = Left;
+			if (Right < Heap.Num() && IsLess(Heap[Right], Heap[Smallest])) Smallest = Right;
+			if (Smallest == Pos) break;
+			Swap(Pos, Smallest);
+			Pos = Smallest;
+		}
+	}
+};
+
+// cell search arrays of one thread (GetGates, GetPath). chunk build workers & path thread keep theirs.
+// every search resets them, memory stays.
+class FSearchScratch : public TThreadSingleton<FSearchScratch>
+{
+public:
+	TArray<FNode> Frontier;
 	TArray<bool> Visited;
-	Visited.SetNum(FrontierNum);
-	for (auto& Elem : Visited) Elem = false; // init
+	FOpenList OpenList;
+	TArray<FIntPoint> Neighbors;
+	TArray<TPair<FIntPoint, float>> Edges;
+
+	// Frontier is only read where Visited is set, so old nodes can stay.
+	void Reset(const int32& NodeNum)
+	{
+		if (Frontier.Num() < NodeNum) Frontier.SetNum(NodeNum);
+		Visited.Reset();
+		Visited.SetNumZeroed(NodeNum);
+		OpenList.Reset(NodeNum);
+	}
+};
+
+// node of the abstract (chunk level) search. Gate comes into a chunk.
+struct FGateNode
+{
+	FGateNode(const FGate& Gate, const float& GCost, const int32& CameFrom) : Gate(Gate), GCost(GCost), CameFrom(CameFrom) {};
+
+	FGate Gate;
+	float GCost;
+	int32 CameFrom; // node index. INDEX_NONE for start
+};
 
-	Visited[ GetFlatIndex(Start, RowNum) ] = true;
-	Frontier[ GetFlatIndex(Start, RowNum) ] = FNode(0, GetGlobalMoveCost(StartCell, EndCell), NoConnection, true, NoConnection, NoConnection);
+// Chunk Level A*. HPA* on cached chunk graphs, never touches cells except in start & end chunk.
+// StartCell & EndCell == GlobalGrid.
+// OutGatePath: FGate(StartCell), gates between chunks (A inside, B next chunk) ..., FGate(EndCell)
+// no chunk is entered twice. LandscapeManager keeps one gate pair per chunk.
+bool FPathFinder::GetGatePath(const FIntPoint& StartCell, const FIntPoint& EndCell, TArray<FGate>& OutGatePath, const std::atomic<bool>* Cancelled, const TSet<FIntPoint>* UsedChunks)
+{
+	FIntPoint StartChunk = GetChunk(StartCell);
+	FIntPoint EndChunk = GetChunk(EndCell);
+
+	OutGatePath.Empty();
+	if (StartChunk == EndChunk)
+	{
+		OutGatePath.Add(FGate(StartCell));
+		OutGatePath.Add(FGate(EndCell));
+		return true;
+	}
+
+	// search box is one chunk bigger than start & end.
+	// 0 0 0 0
+	// 0 0 e 0
+	// 0 s 0 0
+	// 0 0 0 0
+	FIntPoint BoxMin( FMath::Min(StartChunk.X, EndChunk.X) - 1, FMath::Min(StartChunk.Y, EndChunk.Y) - 1 );
+	FIntPoint BoxMax( FMath::Max(StartChunk.X, EndChunk.X) + 1, FMath::Max(StartChunk.Y, EndChunk.Y) + 1 );
+	if ((BoxMax.X - BoxMin.X + 1) * (BoxMax.Y - BoxMin.Y + 1) > 500 * 500)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Start-End box too big."));
+		return false;
+	}
+
+	// start & end cells aren't exits. they get their own cost field.
+	FChunkGraphPtr StartGraph = GetChunkGraph(StartChunk);
+	FChunkGraphPtr EndGraph = GetChunkGraph(EndChunk);
+	FCostGridPtr StartGrid = GetCostGrid(StartChunk);
+	FCostGridPtr EndGrid = GetCostGrid(EndChunk);
+
+	TArray<FIntPoint> StartTargets, EndTargets;
+	for (auto& Exit : StartGraph->Exits) StartTargets.Add(GlobalToLocal(StartChunk, Exit.A));
+	for (auto& Exit : EndGraph->Exits) EndTargets.Add(GlobalToLocal(EndChunk, Exit.A));
+
+	FIntPoint Start = GlobalToLocal(StartChunk, StartCell);
+	FIntPoint End = GlobalToLocal(EndChunk, EndCell);
+	TArray<float> StartField, EndField; // cost is the same both ways, so EndField works as cost to the end.
+	GetCostField(*StartGrid, Start, StartTargets, StartField);
+	GetCostField(*EndGrid, End, EndTargets, EndField);
+
+	// node 0 is start, node 1 is goal. rest are gates, found by Gate.B
+	TArray<FGateNode> Nodes;
+	TMap<FIntPoint, int32> NodeIndices;
+	Nodes.Add(FGateNode(FGate(StartCell), 0, INDEX_NONE));
+	Nodes.Add(FGateNode(FGate(EndCell), INFLOAT, INDEX_NONE));
+	const int32 StartNode = 0;
+	const int32 GoalNode = 1;
+
+	FOpenList OpenList(2);
+	OpenList.Push(StartNode, GetGlobalMoveCost(StartCell, EndCell));
+
+	// true if the path ending at node From already went through Chunk.
+	auto IsOnPath = [&](const FIntPoint& Chunk, const int32& From)
+	{
+		for (int32 Index = From; Index != INDEX_NONE; Index = Nodes[Index].CameFrom)
+			if (GetChunk(Nodes[Index].Gate.B) == Chunk) return true;
+		return false;
+	};
 
-	TMap<FIntPoint, FGate> GateMap;			// Key is Chunk, Value is Gate. Gate is lowest GCost gate that comes into the chunk. ( startgate )
-	GateMap.Add( Start, FGate(StartCell) );	// only update when cost is lower.
+	// opens gate node if it's in the box, its chunk is new to the path and this is the lowest cost visit.
+	auto Visit = [&](const FGate& Gate, const float& NewCost, const int32& CameFrom)
+	{
+		FIntPoint Chunk = GetChunk(Gate.B);
+		if (Chunk.X < BoxMin.X || Chunk.X > BoxMax.X || Chunk.Y < BoxMin.Y || Chunk.Y > BoxMax.Y) return;
+		if (UsedChunks && UsedChunks->Contains(Chunk)) return;
+		if (IsOnPath(Chunk, CameFrom)) return;
+
+		int32 Index;
+		int32* Found = NodeIndices.Find(Gate.B);
+		if (Found)
+		{
+			Index = *Found;
+			if (Nodes[Index].GCost <= NewCost + 0.01f) return; // add to ignore irrelavent difference
+		}
+		else
+		{
+			Index = Nodes.Add(FGateNode(Gate, INFLOAT, INDEX_NONE));
+			NodeIndices.Add(Gate.B, Index);
+		}
 
-	FIntPoint OpenListStart = Start;
-	FIntPoint OpenListEnd = Start;
+		Nodes[Index].GCost = NewCost;
+		Nodes[Index].CameFrom = CameFrom;
+		OpenList.Push(Index, NewCost + GetGlobalMoveCost(Gate.B, EndCell));
+	};
 
 	int32 Counter = 0;
 
 	// start A*
-	while (OpenListStart != NoConnection && OpenListEnd != NoConnection)
+	while (!OpenList.IsEmpty())
 	{
 		if (Counter >= pLM->CounterHardLock)
 		{
@@ -108,44 +302,20 @@ bool FPathFinder::GetGatePath(const FIntPoint& StartCell, const FIntPoint& EndCe
 			break;
 		}
 		Counter++;
+		if (Cancelled && *Cancelled) return false;
 
-		// find lowest GCost node. (highest priority node)
-		float LowestCost = INFLOAT;
-		FIntPoint Current = NoConnection;
-		for ( FIntPoint Finder = OpenListStart; Finder != NoConnection; Finder = Frontier[GetFlatIndex(Finder, RowNum)].Next )
-		{
-			FNode& FinderNode = Frontier[GetFlatIndex(Finder, RowNum)];
-			if (LowestCost > FinderNode.FCost)
-			{
-				Current = Finder;
-				LowestCost = FinderNode.FCost;
-			}
-		}
-		// now Current == LowestCost LocalGrid in open list
-
-	
-		if ( Current == NoConnection ) // something went off.
-		{ return false; }
-
-		FGate* CurrentGate = GateMap.Find(Current);
-		if (!CurrentGate) 
-		{ UE_LOG(LogTemp, Warning, TEXT("CurrentGate Nullptr Error")); return false; }
+		// pop lowest FCost node. (highest priority node)
+		int32 Current = OpenList.Pop();
 
 		// ----------if met goal---------
-		if (Current == End)
+		if (Current == GoalNode)
 		{
-			// UE_LOG(LogTemp, Warning, TEXT("Current %s Goal %s"), *Current.ToString(), *End.ToString());
-			// do data passing
 			TArray<FGate> ReversePath;
-			while (Current != NoConnection)
+			for (int32 Index = Nodes[GoalNode].CameFrom; Index != INDEX_NONE; Index = Nodes[Index].CameFrom)
 			{
-				CurrentGate = GateMap.Find( Current );
-				ReversePath.Add( *CurrentGate );
-				Current = Frontier[GetFlatIndex(Current, RowNum)].CameFrom;
-
+				ReversePath.Add(Nodes[Index].Gate);
 			}
 
-			OutGatePath.Empty();
 			OutGatePath.SetNum(ReversePath.Num());
 			for (int32 i = 0; i < ReversePath.Num(); i++)
 			{
@@ -156,71 +326,52 @@ bool FPathFinder::GetGatePath(const FIntPoint& StartCell, const FIntPoint& EndCe
 		}
 
 		// ---------if didn't meet goal---------
-		FNode& NodeNow = Frontier[ GetFlatIndex(Current, RowNum) ];
-		TMap< FIntPoint, TPair<FGate, float> > NeighborGates;
-		GetGates( *CurrentGate, EndCell, NeighborGates);
-		for (auto& NeighborGate : NeighborGates)
+		// copy. Visit can grow Nodes.
+		const FGateNode NodeNow = Nodes[Current];
+
+		if (Current == StartNode)
 		{
-			FIntPoint Neighbor = NeighborGate.Key + Offset;	// FIntPoint
-			float GCost = NeighborGate.Value.Value;	// TPair< FGate, "float" >
-			FGate Gate = NeighborGate.Value.Key;	// TPair< "FGate", float > 
-			// continue if out of bounds
-			if ( !IsInBoundary( Neighbor, FrontierSize ) )
-			{ continue; }
+			for (int32 To = 0; To < StartGraph->Exits.Num(); To++)
+			{
+				// considering turn radius.
+				if (GetUnitDistSqr(Start, StartTargets[To]) < FMath::Square(UnitMinTurnRadius * 2)) continue;
 
-			// continue if 'visited && lower cost'
-			float NewCost = NodeNow.GCost + GCost;
-			if ( Visited[GetFlatIndex(Neighbor, RowNum)] == true
-				&&
-				Frontier[GetFlatIndex(Neighbor, RowNum)].GCost <= NewCost + 0.01 ) // add to ignore irrelavent difference
-			{ continue; }
+				float Cost = StartField[GetFlatIndex(StartTargets[To])];
+				if (Cost >= INFLOAT) continue;
+				Visit(StartGraph->Exits[To], NodeNow.GCost + Cost + StartGraph->CrossCosts[To], Current);
+			}
+			continue;
+		}
 
-			// this is lowest cost visit.
-			GateMap.Add( Neighbor, Gate );
-			float Heuristic = GetGlobalMoveCost(Gate.B, EndCell);
-			FNode& NodeNext = Frontier[ GetFlatIndex(Neighbor, RowNum) ];
-			NodeNext.GCost = NewCost;
-			NodeNext.FCost = NewCost + Heuristic;
-			NodeNext.CameFrom = Current;
-			Visited[GetFlatIndex(Neighbor, RowNum)] = true; // visited.
+		FIntPoint Chunk = GetChunk(NodeNow.Gate.B);
+		// its CameFrom was lowered since it was opened, and the cheaper way in already went through here.
+		if (IsOnPath(Chunk, NodeNow.CameFrom)) continue;
+
+		FChunkGraphPtr Graph = (Chunk == EndChunk) ? EndGraph : GetChunkGraph(Chunk);
+		int32 From = Graph->FindExit(NodeNow.Gate.B);
+		if (From == INDEX_NONE)
+		{ UE_LOG(LogTemp, Warning, TEXT("Gate %s has no exit in chunk %s"), *NodeNow.Gate.B.ToString(), *Chunk.ToString()); continue; }
 
-			// add this to open list
-			if (!NodeNext.IsOpen)
+		if (Chunk == EndChunk)
+		{
+			float Cost = NodeNow.GCost + EndField[GetFlatIndex(EndTargets[From])];
+			if (Cost < Nodes[GoalNode].GCost)
 			{
-				Frontier[GetFlatIndex(OpenListEnd, RowNum)].Next = Neighbor;
-				NodeNext.Prev = OpenListEnd;
-				NodeNext.Next = NoConnection;
-				NodeNext.IsOpen = true;
-				OpenListEnd = Neighbor;
+				Nodes[GoalNode].GCost = Cost;
+				Nodes[GoalNode].CameFrom = Current;
+				OpenList.Push(GoalNode, Cost);
 			}
 		}
 
-		// update list start and end
-		if (OpenListStart == Current)
-		{
-			OpenListStart = NodeNow.Next;
-		}
-		if (OpenListEnd == Current)
+		const int32 ExitNum = Graph->Exits.Num();
+		for (int32 To = 0; To < ExitNum; To++)
 		{
-			OpenListEnd = NodeNow.Prev;
+			float Cost = Graph->Costs[From * ExitNum + To];
+			if (Cost >= INFLOAT) continue;
+			Visit(Graph->Exits[To], NodeNow.GCost + Cost, Current);
 		}
-		// remove current from open list.
-		NodeNow.IsOpen = false;
-		if (NodeNow.Prev != NoConnection)
-		{
-			FNode& PrevNode = Frontier[GetFlatIndex(NodeNow.Prev, RowNum)];
-			PrevNode.Next = NodeNow.Next;
-		}
-		if (NodeNow.Next != NoConnection)
-		{
-			FNode& NextNode = Frontier[GetFlatIndex(NodeNow.Next, RowNum)];
-			NextNode.Prev = NodeNow.Prev;
-		}
-
-
 	}
 
-
 	return false; // no path found
 }
 
@@ -244,23 +395,29 @@ void FPathFinder::GetGates(const FGate& StartGate, const FIntPoint& GlobalGoal,
 	FIntPoint Start = GlobalToLocal(Chunk, StartGate.B);
 	FIntPoint Goal = GlobalToLocal(Chunk, GlobalGoal);
 
-	TArray<FNode> Frontier;
+	// cached costs of this chunk. goal is usually out of the tile, so get it once.
+	FCostGridPtr GridPtr = GetCostGrid(Chunk);
+	const FCostGrid& Grid = *GridPtr;
+	const FHeightTile& Tile = *Grid.Tile;
+	float GoalHeight = GetCellHeight(Tile, Goal);
+
 	int32 FrontierNum = FMath::Square((pLM->VerticesPerChunk - 1)); // num of cells
-	Frontier.SetNum(FrontierNum);
+	FSearchScratch& Scratch = FSearchScratch::Get();
+	Scratch.Reset(FrontierNum);
+	TArray<FNode>& Frontier = Scratch.Frontier;
+	TArray<bool>& Visited = Scratch.Visited;
+	FOpenList& OpenList = Scratch.OpenList;
+	TArray<FIntPoint>& Neighbors = Scratch.Neighbors;
 
-	TArray<bool> Visited;
-	Visited.SetNum(FrontierNum);
-	for (auto& Elem : Visited) { Elem = false; }
 	Visited[GetFlatIndex(Start)] = true;
-	Frontier[GetFlatIndex(Start)] = FNode(0, GetMoveCost(Chunk, Start, Goal), NoConnection, true, NoConnection, NoConnection);
+	Frontier[GetFlatIndex(Start)] = FNode(0, GetMoveCost(Tile, Start, Goal, GoalHeight), NoConnection);
 
-	FIntPoint OpenListStart = Start;
-	FIntPoint OpenListEnd = Start;
+	OpenList.Push(GetFlatIndex(Start), Frontier[GetFlatIndex(Start)].FCost);
 
 	int32 Counter = 0;
 
 	// start A*
-	while (OpenListStart != NoConnection && OpenListEnd != NoConnection)
+	while (!OpenList.IsEmpty())
 	{
 		if (Counter >= pLM->CounterHardLock)
 		{
@@ -269,24 +426,8 @@ void FPathFinder::GetGates(const FGate& StartGate, const FIntPoint& GlobalGoal,
 		}
 		Counter++;
 
-		// find lowest GCost node. (highest priority node)
-		float LowestCost = INFLOAT;
-		FIntPoint Current = NoConnection;
-		for (FIntPoint Finder = OpenListStart; Finder != NoConnection; Finder = Frontier[GetFlatIndex(Finder)].Next)
-		{
-			FNode& FinderNode = Frontier[GetFlatIndex(Finder)];
-			if (LowestCost > FinderNode.FCost)
-			{
-				Current = Finder;
-				LowestCost = FinderNode.FCost;
-			}
-		}
-		// now Current == LowestCost LocalGrid in open list
-
-		if (Current == NoConnection) // something went off.
-		{
-			return;
-		}
+		// pop lowest FCost node. (highest priority node)
+		FIntPoint Current = GetIndex2D(OpenList.Pop());
 
 		if (DrawDebug) // false by defualt
 		{
@@ -305,10 +446,10 @@ void FPathFinder::GetGates(const FGate& StartGate, const FIntPoint& GlobalGoal,
 		if ( IsOnBoundary(Current) && GetUnitDistSqr(Start, Current) >= FMath::Square(UnitMinTurnRadius*2) ) // considering turn radius.
 		{
 			// find possible edges.
-			TArray<FIntPoint> NeighborsTemp;
-			GetNeighbors(Current, NeighborsTemp);
-			TArray<TPair<FIntPoint, float>> Edges;
-			for (auto& Neighbor : NeighborsTemp)
+			GetNeighbors(Current, Neighbors);
+			TArray<TPair<FIntPoint, float>>& Edges = Scratch.Edges;
+			Edges.Reset();
+			for (auto& Neighbor : Neighbors)
 			{
 				if ( !IsInBoundary(Neighbor)
 					/*&& !OutGates.Contains( GetChunk( LocalToGlobal( Chunk, Neighbor ) ) ) */
@@ -317,8 +458,8 @@ void FPathFinder::GetGates(const FGate& StartGate, const FIntPoint& GlobalGoal,
 					// out of boundary (gate) && Not a already found gate && slope traversable
 					// this fills outgates with gates that are found first. so if already found, no need to update.
 					// Total Cost + To Next Cost + Heuristic
-					float MoveCost = GetMoveCost(Chunk, Current, Neighbor);
-					if (GetTanSqr(Chunk, Current, Neighbor) > MaxSlopeTanSqr) MoveCost *= 2;
+					float MoveCost = Grid.GetMoveCost(Current, Neighbor);
+					if (Grid.IsSlopeViolated(Current, Neighbor)) MoveCost *= 2;
 
 					float GCost = NodeNow.GCost + MoveCost;
 					Edges.Add(TPair<FIntPoint, float>(Neighbor, GCost));
@@ -377,7 +518,6 @@ void FPathFinder::GetGates(const FGate& StartGate, const FIntPoint& GlobalGoal,
 
 
 		// ---------if didn't meet goal---------
-		TArray<FIntPoint> Neighbors;
 		GetNeighbors(Current, Neighbors);
 		for (auto& Neighbor : Neighbors)
 		{
@@ -389,8 +529,8 @@ void FPathFinder::GetGates(const FGate& StartGate, const FIntPoint& GlobalGoal,
 			}
 
 			// multiply movecost if slope violated.
-			float MoveCost = GetMoveCost(Chunk, Current, Neighbor);
-			if (GetTanSqr(Chunk, Current, Neighbor) > MaxSlopeTanSqr) MoveCost *= SlopeViolationPanelty;
+			float MoveCost = Grid.GetMoveCost(Current, Neighbor);
+			if (Grid.IsSlopeViolated(Current, Neighbor)) MoveCost *= SlopeViolationPanelty;
 
 			// continue if 'visited && lower cost'
 			float NewCost = NodeNow.GCost + MoveCost;
@@ -401,44 +541,15 @@ void FPathFinder::GetGates(const FGate& StartGate, const FIntPoint& GlobalGoal,
 				continue;
 			}
 
-			float Heuristic = GetMoveCost(Chunk, Neighbor, Goal);
+			float Heuristic = GetMoveCost(Tile, Neighbor, Goal, GoalHeight);
 			FNode& NodeNext = Frontier[GetFlatIndex(Neighbor)];
 			NodeNext.GCost = NewCost;
 			NodeNext.FCost = NewCost + Heuristic;
 			NodeNext.CameFrom = Current;
 			Visited[GetFlatIndex(Neighbor)] = true; // visited.
 
-			// add this to open list
-			if (!NodeNext.IsOpen)
-			{
-				Frontier[GetFlatIndex(OpenListEnd)].Next = Neighbor;
-				NodeNext.Prev = OpenListEnd;
-				NodeNext.Next = NoConnection;
-				NodeNext.IsOpen = true;
-				OpenListEnd = Neighbor;
-			}
-		}
-
-		// update list start and end
-		if (OpenListStart == Current)
-		{
-			OpenListStart = NodeNow.Next;
-		}
-		if (OpenListEnd == Current)
-		{
-			OpenListEnd = NodeNow.Prev;
-		}
-		// remove current from open list.
-		NodeNow.IsOpen = false;
-		if (NodeNow.Prev != NoConnection)
-		{
-			FNode& PrevNode = Frontier[GetFlatIndex(NodeNow.Prev)];
-			PrevNode.Next = NodeNow.Next;
-		}
-		if (NodeNow.Next != NoConnection)
-		{
-			FNode& NextNode = Frontier[GetFlatIndex(NodeNow.Next)];
-			NextNode.Prev = NodeNow.Prev;
+			// add this to open list (or update its cost)
+			OpenList.Push(GetFlatIndex(Neighbor), NodeNext.FCost);
 		}
 
 
@@ -489,26 +600,29 @@ bool FPathFinder::GetPath(const FGate& StartGate, const FGate& EndGate, TArray<F
 	FIntPoint Start = GlobalToLocal(Chunk, StartGate.B);
 	FIntPoint End = GlobalToLocal(Chunk, EndGate.A);
 
-	TArray<FNode> Frontier;
+	// cached costs of this chunk.
+	FCostGridPtr GridPtr = GetCostGrid(Chunk);
+	const FCostGrid& Grid = *GridPtr;
+	const FHeightTile& Tile = *Grid.Tile;
+	float EndHeight = GetCellHeight(Tile, End);
+
 	int32 FrontierNum = FMath::Square((pLM->VerticesPerChunk - 1));
-	Frontier.SetNum(FrontierNum);
+	FSearchScratch& Scratch = FSearchScratch::Get();
+	Scratch.Reset(FrontierNum);
+	TArray<FNode>& Frontier = Scratch.Frontier;
+	TArray<bool>& Visited = Scratch.Visited;
+	FOpenList& OpenList = Scratch.OpenList;
+	TArray<FIntPoint>& Neighbors = Scratch.Neighbors;
 
-	TArray<bool> Visited;
-	Visited.SetNum(FrontierNum);
-	for (auto& Elem : Visited)
-	{
-		Elem = false;
-	}
 	Visited[GetFlatIndex(Start)] = true;
-	Frontier[GetFlatIndex(Start)] = FNode(0, GetMoveCost(Chunk, Start, End), NoConnection, true, NoConnection, NoConnection);
+	Frontier[GetFlatIndex(Start)] = FNode(0, GetMoveCost(Tile, Start, End, EndHeight), NoConnection);
 
-	FIntPoint OpenListStart = Start;
-	FIntPoint OpenListEnd = Start;
+	OpenList.Push(GetFlatIndex(Start), Frontier[GetFlatIndex(Start)].FCost);
 
 	int32 Counter = 0;
 
 	// start A*
-	while (OpenListStart != NoConnection && OpenListEnd != NoConnection)
+	while (!OpenList.IsEmpty())
 	{
 		if (Counter >= pLM->CounterHardLock)
 		{
@@ -517,24 +631,8 @@ bool FPathFinder::GetPath(const FGate& StartGate, const FGate& EndGate, TArray<F
 		}
 		Counter++;
 
-		// find lowest GCost node. (highest priority node)
-		float LowestCost = INFLOAT;
-		FIntPoint Current = NoConnection;
-		for (FIntPoint Finder = OpenListStart; Finder != NoConnection; Finder = Frontier[GetFlatIndex(Finder)].Next)
-		{
-			FNode& FinderNode = Frontier[GetFlatIndex(Finder)];
-			if (LowestCost > FinderNode.FCost)
-			{
-				Current = Finder;
-				LowestCost = FinderNode.FCost;
-			}
-		}
-		// now Current == LowestCost LocalGrid in open list
-
-		if (Current == NoConnection) // something went off.
-		{
-			return false;
-		}
+		// pop lowest FCost node. (highest priority node)
+		FIntPoint Current = GetIndex2D(OpenList.Pop());
 
 		if (DrawDebug) // false by defualt
 		{
@@ -574,7 +672,6 @@ bool FPathFinder::GetPath(const FGate& StartGate, const FGate& EndGate, TArray<F
 		}
 		
 		// ---------if didn't meet goal---------
-		TArray<FIntPoint> Neighbors;
 		FNode& NodeNow = Frontier[GetFlatIndex(Current)];
 		GetNeighbors(Current, Neighbors);
 		for (auto& Neighbor : Neighbors)
@@ -587,8 +684,8 @@ bool FPathFinder::GetPath(const FGate& StartGate, const FGate& EndGate, TArray<F
 			}
 
 			// multiply movecost if slope violated.
-			float MoveCost = GetMoveCost(Chunk, Current, Neighbor);
-			if (GetTanSqr(Chunk, Current, Neighbor) > MaxSlopeTanSqr) MoveCost *= SlopeViolationPanelty;
+			float MoveCost = Grid.GetMoveCost(Current, Neighbor);
+			if (Grid.IsSlopeViolated(Current, Neighbor)) MoveCost *= SlopeViolationPanelty;
 
 			// continue if 'visited && lower cost'
 			float NewCost = NodeNow.GCost + MoveCost;
@@ -599,44 +696,15 @@ bool FPathFinder::GetPath(const FGate& StartGate, const FGate& EndGate, TArray<F
 				continue;
 			}
 			
-			float Heuristic = GetMoveCost(Chunk, Neighbor, End);
+			float Heuristic = GetMoveCost(Tile, Neighbor, End, EndHeight);
 			FNode& NodeNext = Frontier[GetFlatIndex(Neighbor)];
 			NodeNext.GCost = NewCost;
 			NodeNext.FCost = NewCost + Heuristic;
 			NodeNext.CameFrom = Current;
 			Visited[GetFlatIndex(Neighbor)] = true; // visited.
 
-			// add this to open list
-			if (!NodeNext.IsOpen)
-			{
-				Frontier[GetFlatIndex(OpenListEnd)].Next = Neighbor;
-				NodeNext.Prev = OpenListEnd;
-				NodeNext.Next = NoConnection;
-				NodeNext.IsOpen = true;
-				OpenListEnd = Neighbor;
-			}
-		}
-
-		// update list start and end
-		if (OpenListStart == Current)
-		{
-			OpenListStart = NodeNow.Next;
-		}
-		if (OpenListEnd == Current)
-		{
-			OpenListEnd = NodeNow.Prev;
-		}
-		// remove current from open list.
-		NodeNow.IsOpen = false;
-		if (NodeNow.Prev != NoConnection)
-		{
-			FNode& PrevNode = Frontier[GetFlatIndex(NodeNow.Prev)];
-			PrevNode.Next = NodeNow.Next;
-		}
-		if (NodeNow.Next != NoConnection)
-		{
-			FNode& NextNode = Frontier[GetFlatIndex(NodeNow.Next)];
-			NextNode.Prev = NodeNow.Prev;
+			// add this to open list (or update its cost)
+			OpenList.Push(GetFlatIndex(Neighbor), NodeNext.FCost);
 		}
 
 
@@ -659,6 +727,7 @@ void FPathFinder::SmoothPath(TArray<FIntPoint>& Path)
 	//--------------Walkable Check-----------------(skipping)
 
 	FIntPoint Chunk = GetChunk(Path[1]);
+	FCostGridPtr GridPtr = GetCostGrid(Chunk);
 	TArray<FIntPoint> SmoothPath;
 
 	SmoothPath.Add(Path[0]);	// keep StartGate.A
@@ -670,7 +739,7 @@ void FPathFinder::SmoothPath(TArray<FIntPoint>& Path)
 	
 	while (CurrentPoint <= LastIndex - 2)
 	{
-		if (IsWalkable(Chunk, GlobalToLocal(Chunk, Path[CheckPoint]), GlobalToLocal(Chunk, Path[CurrentPoint])))
+		if (IsWalkable(*GridPtr, GlobalToLocal(Chunk, Path[CheckPoint]), GlobalToLocal(Chunk, Path[CurrentPoint])))
 		{
 			CurrentPoint++;
 		}
@@ -816,17 +885,55 @@ FVector2D FPathFinder::RebuildPath(const TArray<FIntPoint>& SmoothPath, TArray<F
 	
 }
 
-// Macro.
+// Macro. same gates & direction always make the same road, so it's cached.
 FVector2D FPathFinder::GetActualPath(const FGate& StartGate, const FGate& EndGate, TArray<FVector>& OutPath, const FVector2D& StartDirection)
 {
+	FActualPathKey Key{ StartGate, EndGate, StartDirection };
+	FActualPathPtr Found;
+	{
+		FScopeLock Lock(&PathMutex);
+		const FActualPathPtr* pFound = ActualPaths.FindAndTouch(Key);
+		if (pFound) Found = *pFound;
+	}
+
+	if (Found) PathHitCount++;
+	else
+	{
+		PathMissCount++;
+
+		// make without lock. first one wins if two threads made it.
+		FActualPathPtr NewPath = MakeActualPath(StartGate, EndGate, StartDirection);
+
+		FScopeLock Lock(&PathMutex);
+		const FActualPathPtr* pFound = ActualPaths.FindAndTouch(Key);
+		if (pFound) Found = *pFound;
+		else
+		{
+			ActualPaths.Add(Key, NewPath);
+			Found = NewPath;
+		}
+	}
+
+	OutPath = Found->Path;
+	return Found->LastDirection;
+}
+
+void FPathFinder::EmptyPathCache()
+{
+	FScopeLock Lock(&PathMutex);
+	ActualPaths.Empty(ActualPaths.Max());
+}
+
+FActualPathPtr FPathFinder::MakeActualPath(const FGate& StartGate, const FGate& EndGate, const FVector2D& StartDirection)
+{
+	TSharedPtr<FActualPath, ESPMode::ThreadSafe> Out = MakeShared<FActualPath, ESPMode::ThreadSafe>();
 
 	TArray<FIntPoint> Path;
 	GetPath(StartGate, EndGate, Path);
 	SmoothPath(Path);
 
-	OutPath.Empty();
-	FVector2D LastDir = RebuildPath(Path, OutPath, StartDirection);
-	return LastDir;
+	Out->LastDirection = RebuildPath(Path, Out->Path, StartDirection);
+	return Out;
 }
 
 
@@ -834,7 +941,7 @@ FVector2D FPathFinder::GetActualPath(const FGate& StartGate, const FGate& EndGat
 
 // ---- private -----
 
-bool FPathFinder::IsWalkable(const FIntPoint& Chunk, const FIntPoint& A, const FIntPoint& B)
+bool FPathFinder::IsWalkable(const FCostGrid& Grid, const FIntPoint& A, const FIntPoint& B)
 {
 	if ( !IsInBoundary(A) || !IsInBoundary(B) )
 	{
@@ -856,7 +963,7 @@ bool FPathFinder::IsWalkable(const FIntPoint& Chunk, const FIntPoint& A, const F
 	FVector2D Next = LocalA + Direction;
 	while ( GetDistSqr(LocalA, Next) <= DistSqr )
 	{
-		if ( GetTanSqr(Chunk, Now, Next) > MaxSlopeTanSqr )
+		if ( GetTanSqr(*Grid.Tile, Now, Next) > MaxSlopeTanSqr )
 		{
 			return false;
 		}
@@ -890,6 +997,29 @@ float FPathFinder::GetCellHeight(const FIntPoint& Chunk, const FIntPoint& LocalG
 	return GetCellHeight(LocalToGlobal(Chunk, LocalGrid));
 }
 
+// bilinear between cached cell centers. terrain is way smoother than a cell, so it's close to noise.
+float FPathFinder::GetHeight(const FHeightTile& Tile, const FVector2D& Local)
+{
+	FVector2D CellPos = Local / pLM->VertexSpacing - FVector2D(0.5f, 0.5f); // cell center space
+	FIntPoint Cell(FMath::FloorToInt32(CellPos.X), FMath::FloorToInt32(CellPos.Y));
+	float AlphaX = CellPos.X - Cell.X;
+	float AlphaY = CellPos.Y - Cell.Y;
+
+	float H00 = GetCellHeight(Tile, Cell);
+	float H10 = GetCellHeight(Tile, Cell + FIntPoint(1, 0));
+	float H01 = GetCellHeight(Tile, Cell + FIntPoint(0, 1));
+	float H11 = GetCellHeight(Tile, Cell + FIntPoint(1, 1));
+
+	return FMath::Lerp(FMath::Lerp(H00, H10, AlphaX), FMath::Lerp(H01, H11, AlphaX), AlphaY);
+}
+
+// reads tile if it has the cell, otherwise noise.
+float FPathFinder::GetCellHeight(const FHeightTile& Tile, const FIntPoint& LocalGrid)
+{
+	if (Tile.HasCell(LocalGrid)) return Tile.GetCellHeight(LocalGrid);
+	return GetCellHeight(Tile.Chunk, LocalGrid);
+}
+
 FIntPoint FPathFinder::LocalToGlobal(const FIntPoint& Chunk, const FIntPoint& LocalGrid)
 {
 	return Chunk * (pLM->VerticesPerChunk - 1) + LocalGrid;
@@ -939,6 +1069,17 @@ float FPathFinder::GetMoveCost(const FIntPoint& Chunk, const FIntPoint& A, const
 	return GetMoveCost(A, B) + UnitHeight;
 }
 
+float FPathFinder::GetMoveCost(const FHeightTile& Tile, const FIntPoint& A, const FIntPoint& B)
+{
+	return GetMoveCost(Tile, A, B, GetCellHeight(Tile, B));
+}
+
+// HeightB given. for targets out of the tile (goal), so it's not sampled again every call.
+float FPathFinder::GetMoveCost(const FHeightTile& Tile, const FIntPoint& A, const FIntPoint& B, const float& HeightB)
+{
+	float UnitHeight = ( FMath::Abs( GetCellHeight(Tile, A) - HeightB ) ) / pLM->VertexSpacing;
+	return GetMoveCost(A, B) + UnitHeight;
+}
 
 float FPathFinder::GetTanSqr(const FIntPoint& Chunk, const FIntPoint& A, const FIntPoint& B)
 {
@@ -950,6 +1091,16 @@ float FPathFinder::GetTanSqr(const FIntPoint& Chunk, const FIntPoint& A, const F
 	return TanSqr;
 }
 
+float FPathFinder::GetTanSqr(const FHeightTile& Tile, const FIntPoint& A, const FIntPoint& B)
+{
+	float UnitDistSqr = GetUnitDistSqr(A, B);
+	float UnitHeightSqr = ( GetCellHeight(Tile, A) - GetCellHeight(Tile, B) ) / pLM->VertexSpacing;
+	UnitHeightSqr = FMath::Square(UnitHeightSqr);
+
+	float TanSqr = UnitHeightSqr / UnitDistSqr;
+	return TanSqr;
+}
+
 float FPathFinder::GetTanSqr(const FIntPoint& Chunk, const FVector2D& LocalA, const FVector2D& LocalB)
 {
 	float DistSqr = GetDistSqr(LocalA, LocalB);
@@ -960,6 +1111,270 @@ float FPathFinder::GetTanSqr(const FIntPoint& Chunk, const FVector2D& LocalA, co
 	return TanSqr;
 }
 
+float FPathFinder::GetTanSqr(const FHeightTile& Tile, const FVector2D& LocalA, const FVector2D& LocalB)
+{
+	float DistSqr = GetDistSqr(LocalA, LocalB);
+	float HeightSqr = GetHeight(Tile, LocalA) - GetHeight(Tile, LocalB);
+	HeightSqr = FMath::Square(HeightSqr);
+
+	float TanSqr = HeightSqr / DistSqr;
+	return TanSqr;
+}
+
+// thread safe. makes one if not cached.
+FCostGridPtr FPathFinder::GetCostGrid(const FIntPoint& Chunk)
+{
+	{
+		FScopeLock Lock(&CostGridMutex);
+		const FCostGridPtr* Found = CostGrids.FindAndTouch(Chunk);
+		if (Found) return *Found;
+	}
+
+	// build without lock. first one wins if two threads made it.
+	FCostGridPtr NewGrid = BuildCostGrid(Chunk);
+
+	FScopeLock Lock(&CostGridMutex);
+	const FCostGridPtr* Found = CostGrids.FindAndTouch(Chunk);
+	if (Found) return *Found;
+
+	CostGrids.Add(Chunk, NewGrid);
+	return NewGrid;
+}
+
+// one pass per direction, 4 cells at a time. same math as GetMoveCost & GetTanSqr on the tile.
+FCostGridPtr FPathFinder::BuildCostGrid(const FIntPoint& Chunk)
+{
+	TSharedPtr<FCostGrid, ESPMode::ThreadSafe> Grid = MakeShared<FCostGrid, ESPMode::ThreadSafe>();
+	Grid->Chunk = Chunk;
+	Grid->CellNum = pLM->VerticesPerChunk - 1;
+	Grid->Tile = pLM->GetHeightTile(Chunk);
+
+	const FHeightTile& Tile = *Grid->Tile;
+	const int32 CellNum = Grid->CellNum;
+	const int32 CellCount = CellNum * CellNum;
+	Grid->MoveCosts.SetNumUninitialized(CellCount * 8);
+	Grid->SlopeViolations.SetNumZeroed(CellCount);
+
+	const VectorRegister4Float Spacing = VectorSetFloat1(pLM->VertexSpacing);
+	const VectorRegister4Float MaxTanSqr = VectorSetFloat1(MaxSlopeTanSqr);
+
+	TArray<FIntPoint> Offsets;
+	GetNeighbors(FIntPoint(0, 0), Offsets); // Dir order
+
+	for (int32 Dir = 0; Dir < Offsets.Num(); Dir++)
+	{
+		const FIntPoint& Offset = Offsets[Dir];
+		const VectorRegister4Float BaseCost = VectorSetFloat1(GetMoveCost(FIntPoint(0, 0), Offset));
+		const VectorRegister4Float UnitDistSqr = VectorSetFloat1(float(GetUnitDistSqr(FIntPoint(0, 0), Offset)));
+		float* Costs = Grid->MoveCosts.GetData() + Dir * CellCount;
+
+		for (int32 iY = 0; iY < CellNum; iY++)
+		{
+			// tile rows have one cell border, so (x + dx, y + dy) is always in it.
+			const float* RowA = Tile.CellHeights.GetData() + (iY + 1) * Tile.CellRow + 1;
+			const float* RowB = Tile.CellHeights.GetData() + (iY + 1 + Offset.Y) * Tile.CellRow + 1 + Offset.X;
+
+			int32 iX = 0;
+			for (; iX + 4 <= CellNum; iX += 4)
+			{
+				VectorRegister4Float Diff = VectorSubtract(VectorLoad(RowA + iX), VectorLoad(RowB + iX));
+				VectorRegister4Float UnitHeight = VectorDivide(Diff, Spacing);
+
+				VectorRegister4Float Cost = VectorAdd(BaseCost, VectorAbs(UnitHeight));
+				VectorStore(Cost, Costs + iY * CellNum + iX);
+
+				VectorRegister4Float TanSqr = VectorDivide(VectorMultiply(UnitHeight, UnitHeight), UnitDistSqr);
+				int32 Mask = VectorMaskBits(VectorCompareGT(TanSqr, MaxTanSqr));
+				for (int32 Lane = 0; Lane < 4; Lane++)
+				{
+					if (Mask & (1 << Lane)) Grid->SlopeViolations[iY * CellNum + iX + Lane] |= uint8(1 << Dir);
+				}
+			}
+
+			// leftovers. scalar.
+			for (; iX < CellNum; iX++)
+			{
+				FIntPoint A(iX, iY);
+				Costs[iY * CellNum + iX] = GetMoveCost(Tile, A, A + Offset);
+				if (GetTanSqr(Tile, A, A + Offset) > MaxSlopeTanSqr) Grid->SlopeViolations[iY * CellNum + iX] |= uint8(1 << Dir);
+			}
+		}
+	}
+
+	return Grid;
+}
+
+// thread safe. makes one if not cached.
+FChunkGraphPtr FPathFinder::GetChunkGraph(const FIntPoint& Chunk)
+{
+	{
+		FScopeLock Lock(&ChunkGraphMutex);
+		const FChunkGraphPtr* Found = ChunkGraphs.FindAndTouch(Chunk);
+		if (Found) return *Found;
+	}
+
+	// build without lock. first one wins if two threads made it.
+	FChunkGraphPtr NewGraph = BuildChunkGraph(Chunk);
+
+	FScopeLock Lock(&ChunkGraphMutex);
+	const FChunkGraphPtr* Found = ChunkGraphs.FindAndTouch(Chunk);
+	if (Found) return *Found;
+
+	ChunkGraphs.Add(Chunk, NewGraph);
+	return NewGraph;
+}
+
+// exits + one cost field per exit. fields only read the grid, so they run in parallel.
+FChunkGraphPtr FPathFinder::BuildChunkGraph(const FIntPoint& Chunk)
+{
+	TSharedPtr<FChunkGraph, ESPMode::ThreadSafe> Graph = MakeShared<FChunkGraph, ESPMode::ThreadSafe>();
+	Graph->Chunk = Chunk;
+
+	FCostGridPtr GridPtr = GetCostGrid(Chunk);
+	const FCostGrid& Grid = *GridPtr;
+	GetChunkExits(Grid, Graph->Exits, Graph->ExitSides, Graph->CrossCosts);
+
+	const int32 ExitNum = Graph->Exits.Num();
+	Graph->Costs.Init(INFLOAT, ExitNum * ExitNum);
+
+	TArray<FIntPoint> Targets;
+	for (auto& Exit : Graph->Exits) Targets.Add(GlobalToLocal(Chunk, Exit.A));
+
+	FChunkGraph& GraphRef = *Graph;
+	ParallelFor(ExitNum, [&](int32 From)
+	{
+		TArray<float> Field;
+		GetCostField(Grid, Targets[From], Targets, Field);
+
+		for (int32 To = 0; To < ExitNum; To++)
+		{
+			// no going back out the edge we came in, and considering turn radius.
+			if (GraphRef.ExitSides[From] == GraphRef.ExitSides[To]) continue;
+			if (GetUnitDistSqr(Targets[From], Targets[To]) < FMath::Square(UnitMinTurnRadius * 2)) continue;
+
+			float Cost = Field[GetFlatIndex(Targets[To])];
+			if (Cost >= INFLOAT) continue;
+			GraphRef.Costs[From * ExitNum + To] = Cost + GraphRef.CrossCosts[To];
+		}
+	});
+
+	return Graph;
+}
+
+// EntrancesPerEdge windows on every edge, cheapest straight crossing in each window.
+// only depends on the shared edge's cells, so both chunks of the edge pick the same ones.
+void FPathFinder::GetChunkExits(const FCostGrid& Grid, TArray<FGate>& OutExits, TArray<int32>& OutSides, TArray<float>& OutCrossCosts)
+{
+	OutExits.Empty();
+	OutSides.Empty();
+	OutCrossCosts.Empty();
+
+	const int32 CellNum = Grid.CellNum;
+	const int32 Margin = FMath::Clamp(FMath::CeilToInt32(UnitMinTurnRadius), 0, (CellNum - 1) / 2); // keep off the corners
+	const int32 Length = CellNum - Margin * 2;
+	const int32 WindowNum = FMath::Clamp(EntrancesPerEdge, 1, Length);
+
+	static const FIntPoint SideDirs[4] = { FIntPoint(-1, 0), FIntPoint(1, 0), FIntPoint(0, -1), FIntPoint(0, 1) };
+
+	for (int32 Side = 0; Side < 4; Side++)
+	{
+		for (int32 Window = 0; Window < WindowNum; Window++)
+		{
+			int32 WindowStart = Margin + Length * Window / WindowNum;
+			int32 WindowEnd = Margin + Length * (Window + 1) / WindowNum;
+
+			float BestCost = INFLOAT;
+			FIntPoint BestCell(0, 0);
+			for (int32 i = WindowStart; i < WindowEnd; i++)
+			{
+				FIntPoint Inside;
+				switch (Side)
+				{
+				case 0: Inside = FIntPoint(0, i); break;
+				case 1: Inside = FIntPoint(CellNum - 1, i); break;
+				case 2: Inside = FIntPoint(i, 0); break;
+				default: Inside = FIntPoint(i, CellNum - 1); break;
+				}
+
+				float Cost = GetCrossCost(Grid, Inside, Inside + SideDirs[Side]);
+				if (Cost < BestCost) // first one on tie.
+				{
+					BestCost = Cost;
+					BestCell = Inside;
+				}
+			}
+			if (BestCost >= INFLOAT) continue;
+
+			OutExits.Add(FGate(LocalToGlobal(Grid.Chunk, BestCell), LocalToGlobal(Grid.Chunk, BestCell + SideDirs[Side])));
+			OutSides.Add(Side);
+			OutCrossCosts.Add(BestCost);
+		}
+	}
+}
+
+// Dijkstra over the chunk's cells from Start (local). stops when every target is done.
+// OutCosts[FlatIndex], INFLOAT if not reached.
+void FPathFinder::GetCostField(const FCostGrid& Grid, const FIntPoint& Start, const TArray<FIntPoint>& Targets, TArray<float>& OutCosts)
+{
+	const int32 CellCount = Grid.CellNum * Grid.CellNum;
+	OutCosts.Init(INFLOAT, CellCount);
+
+	const uint8 Done = 1;
+	const uint8 Target = 2;
+	TArray<uint8> Flags;
+	Flags.Init(0, CellCount);
+
+	int32 TargetsLeft = 0;
+	for (auto& Elem : Targets)
+	{
+		uint8& Flag = Flags[GetFlatIndex(Elem)];
+		if (!(Flag & Target)) TargetsLeft++;
+		Flag |= Target;
+	}
+
+	FOpenList OpenList(CellCount);
+	OutCosts[GetFlatIndex(Start)] = 0;
+	OpenList.Push(GetFlatIndex(Start), 0);
+
+	while (!OpenList.IsEmpty())
+	{
+		int32 Index = OpenList.Pop();
+		Flags[Index] |= Done;
+		if ((Flags[Index] & Target) && --TargetsLeft == 0) return;
+
+		FIntPoint Current = GetIndex2D(Index);
+		for (int32 iY = -1; iY <= 1; iY++)
+		{
+			for (int32 iX = -1; iX <= 1; iX++)
+			{
+				FIntPoint Neighbor = Current + FIntPoint(iX, iY);
+				if ((iX == 0 && iY == 0) || !IsInBoundary(Neighbor)) continue;
+
+				int32 NeighborIndex = GetFlatIndex(Neighbor);
+				if (Flags[NeighborIndex] & Done) continue;
+
+				// multiply movecost if slope violated.
+				float MoveCost = Grid.GetMoveCost(Current, Neighbor);
+				if (Grid.IsSlopeViolated(Current, Neighbor)) MoveCost *= SlopeViolationPanelty;
+
+				float NewCost = OutCosts[Index] + MoveCost;
+				if (NewCost >= OutCosts[NeighborIndex]) continue;
+
+				OutCosts[NeighborIndex] = NewCost;
+				OpenList.Push(NeighborIndex, NewCost);
+			}
+		}
+	}
+}
+
+// same as gate edges in GetGates.
+float FPathFinder::GetCrossCost(const FCostGrid& Grid, const FIntPoint& Inside, const FIntPoint& Outside)
+{
+	float MoveCost = Grid.GetMoveCost(Inside, Outside);
+	if (Grid.IsSlopeViolated(Inside, Outside)) MoveCost *= 2;
+	return MoveCost;
+}
+
 // returns arc route of shorter turn.
 bool FPathFinder::GetCurve(const FVector2D& StartDirection, const FVector2D& Current, const FVector2D& Next, TArray<FVector2D>& OutRoute, const float& TurnRadius, const float& NoTurnAngle)
 {
@@ -1088,6 +1503,14 @@ FIntPoint FPathFinder::GetIndex2D(const int32& FlatIndex)
 	return Index2D;
 }
 
+FIntPoint FPathFinder::GetIndex2D(const int32& FlatIndex, const int32& RowNum)
+{
+	FIntPoint Index2D;
+	Index2D.Y = FlatIndex / RowNum;
+	Index2D.X = FlatIndex % RowNum;
+	return Index2D;
+}
+
 int32 FPathFinder::GetUnitDistSqr(const FIntPoint& A, const FIntPoint& B)
 {
 	return FMath::Square(B.X - A.X) + FMath::Square(B.Y - A.Y);
@@ -1100,8 +1523,7 @@ float FPathFinder::GetDistSqr(const FVector2D& A, const FVector2D& B)
 
 void FPathFinder::GetNeighbors(const FIntPoint& A, TArray<FIntPoint>& OutNeighbors)
 {
-	OutNeighbors.Empty();
-	OutNeighbors.Reserve(8);
+	OutNeighbors.Reset(8);
 	for (int32 iY = -1; iY <= 1; iY++)
 	{
 		for (int32 iX = -1; iX <= 1; iX++)
@@ -0,0 +1,123 @@
+
+#include "PathService.h"
+#include "RoadTrainProj.h" // stats
+
+#include "HAL/RunnableThread.h"
+#include "HAL/Event.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Path Queue Length"), STAT_PathQueueLength, STATGROUP_RoadTrain);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Path Job Latency (ms)"), STAT_PathJobLatencyMs, STATGROUP_RoadTrain);
+
+FPathService::FPathService(const EThreadPriority& Priority) : QueueLength(0), ShouldStop(false)
+{
+	WorkEvent = FPlatformProcess::GetSynchEventFromPool(false);
+	Thread = FRunnableThread::Create(this, TEXT("PathServiceThread"), 0, Priority);
+	TickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FPathService::Tick));
+}
+
+FPathService::~FPathService()
+{
+	FTSTicker::GetCoreTicker().RemoveTicker(TickerHandle);
+
+	// running search sees the flag and returns early, so the join is short.
+	{
+		FScopeLock Lock(&Mutex);
+		if (Running) Running->Cancelled = true;
+		FJob Job;
+		for (auto& Queue : Queues)
+			while (Queue.Dequeue(Job))
+			{
+				Job.State->Cancelled = true;
+				Job.State->Done = true;
+			}
+		QueueLength = 0;
+	}
+
+	if (Thread)
+	{
+		Thread->Kill(true); // calls Stop & waits.
+		delete Thread;
+		Thread = nullptr;
+	}
+	FPlatformProcess::ReturnSynchEventToPool(WorkEvent);
+	WorkEvent = nullptr;
+
+	FJob Job;
+	while (Finished.Dequeue(Job)) Job.State->Done = true;
+}
+
+FPathJobHandle FPathService::Enqueue(const EPathJobPriority& Priority, FJobWork&& Work, FJobDone&& Done)
+{
+	FPathJobHandle State = MakeShared<FPathJobState, ESPMode::ThreadSafe>();
+	{
+		FScopeLock Lock(&Mutex);
+		Queues[int32(Priority)].Enqueue(FJob{ State, FPlatformTime::Seconds(), MoveTemp(Work), MoveTemp(Done) });
+	}
+	QueueLength++;
+	WorkEvent->Trigger();
+	return State;
+}
+
+// highest priority queue's front. cancelled jobs are dropped here.
+bool FPathService::PopJob(FJob& OutJob)
+{
+	FScopeLock Lock(&Mutex);
+	Running.Reset();
+	for (int32 p = int32(EPathJobPriority::Num) - 1; p >= 0; p--)
+	{
+		while (Queues[p].Dequeue(OutJob))
+		{
+			QueueLength--;
+
+			if (OutJob.State->Cancelled) { OutJob.State->Done = true; continue; }
+			Running = OutJob.State;
+			return true;
+		}
+	}
+	return false;
+}
+
+uint32 FPathService::Run()
+{
+	while (!ShouldStop)
+	{
+		FJob Job;
+		if (!PopJob(Job))
+		{
+			WorkEvent->Wait(100); // ms. wakes on enqueue anyway.
+			continue;
+		}
+
+		Job.HasResult = Job.Work(*Job.State);
+		Job.Work = nullptr;
+		Finished.Enqueue(MoveTemp(Job));
+	}
+
+	FScopeLock Lock(&Mutex);
+	Running.Reset();
+	return 0;
+}
+
+void FPathService::Stop()
+{
+	ShouldStop = true;
+	WorkEvent->Trigger();
+}
+
+// game thread. callbacks & stats.
+bool FPathService::Tick(float DeltaTime)
+{
+	FJob Job;
+	while (Finished.Dequeue(Job))
+	{
+		float LatencyMs = float((FPlatformTime::Seconds() - Job.EnqueueTime) * 1000.0);
+		AverageLatencyMs = (AverageLatencyMs <= 0.0f) ? LatencyMs : FMath::Lerp(AverageLatencyMs, LatencyMs, 0.1f);
+
+		if (Job.HasResult && Job.Done && !Job.State->Cancelled) Job.Done();
+		Job.State->Done = true;
+	}
+
+	SET_DWORD_STAT(STAT_PathQueueLength, QueueLength);
+	SET_FLOAT_STAT(STAT_PathJobLatencyMs, AverageLatencyMs);
+	return true; // keep ticking.
+}
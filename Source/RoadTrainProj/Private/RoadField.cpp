@@ -0,0 +1,161 @@
+#include "RoadField.h"
+
+#include <limits>
+
+// no feature on this sample. big enough, but still safe to add to.
+static const float RoadFieldNone = TNumericLimits<float>::Max() * 0.25f;
+
+// 1D squared distance transform, lower envelope of parabolas. (Felzenszwalb & Huttenlocher)
+// F in samples^2, RoadFieldNone where there's no feature. OutArgs gets the sample each minimum came from, -1 if none.
+static void RoadFieldTransform1D(const TArray<float>& F, TArray<float>& OutD, TArray<int32>& OutArgs, TArray<int32>& V, TArray<float>& Z)
+{
+	const int32 Num = F.Num();
+	int32 k = -1;
+
+	for (int32 q = 0; q < Num; q++)
+	{
+		if (F[q] >= RoadFieldNone) continue;
+
+		float S = -RoadFieldNone;
+		while (k >= 0)
+		{
+			S = ((F[q] + q * q) - (F[V[k]] + V[k] * V[k])) / float(2 * q - 2 * V[k]);
+			if (S > Z[k]) break;
+			k--;
+			S = -RoadFieldNone;
+		}
+		k++;
+		V[k] = q;
+		Z[k] = S;
+		Z[k + 1] = RoadFieldNone;
+	}
+
+	if (k < 0)
+	{
+		for (int32 q = 0; q < Num; q++)
+		{
+			OutD[q] = RoadFieldNone;
+			OutArgs[q] = -1;
+		}
+		return;
+	}
+
+	int32 j = 0;
+	for (int32 q = 0; q < Num; q++)
+	{
+		while (Z[j + 1] < q) j++;
+		OutD[q] = float((q - V[j]) * (q - V[j])) + F[V[j]];
+		OutArgs[q] = V[j];
+	}
+}
+
+void FRoadField::Reset()
+{
+	Min = FIntPoint(0, 0);
+	Num = FIntPoint(0, 0);
+	Points.Reset();
+	Distances.Reset();
+	RoadHeights.Reset();
+}
+
+void FRoadField::Build(const TArray<FVector>& InPath, const FIntPoint& InMin, const FIntPoint& InNum, const float& InSpacing, const float& MaxGap)
+{
+	Min = InMin;
+	Num = InNum;
+	Spacing = InSpacing;
+
+	// polyline at Spacing. parts of different roads are just appended, the long jump between them isn't a road.
+	Points.Reset();
+	for (int32 i = 0; i < InPath.Num(); i++)
+	{
+		Points.Add(InPath[i]);
+		if (i + 1 >= InPath.Num()) continue;
+
+		float Length = FVector::Dist2D(InPath[i], InPath[i + 1]);
+		if (Length > MaxGap) continue;
+
+		int32 Steps = FMath::CeilToInt32(Length / Spacing);
+		for (int32 s = 1; s < Steps; s++) Points.Add(FMath::Lerp(InPath[i], InPath[i + 1], float(s) / Steps));
+	}
+
+	const int32 Total = FMath::Max(Num.X * Num.Y, 0);
+	Distances.Reset();
+	RoadHeights.Reset();
+	Distances.SetNumUninitialized(Total);
+	for (float& Elem : Distances) Elem = std::numeric_limits<float>::infinity();
+	RoadHeights.SetNumZeroed(Total);
+	if (Total <= 0 || Points.IsEmpty()) return;
+
+	// seeds. every point goes to its closest sample, closest point wins the sample.
+	Seeds.Reset();
+	SeedDistSqr.Reset();
+	Seeds.SetNumUninitialized(Total);
+	SeedDistSqr.SetNumUninitialized(Total);
+	for (int32 i = 0; i < Total; i++)
+	{
+		Seeds[i] = -1;
+		SeedDistSqr[i] = RoadFieldNone;
+	}
+	for (int32 k = 0; k < Points.Num(); k++)
+	{
+		FIntPoint Grid = FIntPoint(FMath::RoundToInt32(Points[k].X / Spacing), FMath::RoundToInt32(Points[k].Y / Spacing));
+		if (!Contains(Grid)) continue;
+
+		int32 Flat = GetFlatIndex(Grid);
+		float DistSqr = FVector2D::DistSquared(FVector2D(Points[k].X, Points[k].Y), FVector2D(Grid.X, Grid.Y) * Spacing);
+		if (DistSqr < SeedDistSqr[Flat])
+		{
+			Seeds[Flat] = k;
+			SeedDistSqr[Flat] = DistSqr;
+		}
+	}
+
+	// scratch for both passes.
+	const int32 MaxNum = FMath::Max(Num.X, Num.Y);
+	F.SetNumUninitialized(MaxNum, false);
+	D.SetNumUninitialized(MaxNum, false);
+	Z.SetNumUninitialized(MaxNum + 1, false);
+	Args.SetNumUninitialized(MaxNum, false);
+	V.SetNumUninitialized(MaxNum, false);
+
+	// columns. ColumnDist = squared samples to the nearest seed in the same column, ColumnSeed = that seed.
+	ColumnDist.SetNumUninitialized(Total, false);
+	ColumnSeed.SetNumUninitialized(Total, false);
+
+	F.SetNum(Num.Y, false);
+	D.SetNum(Num.Y, false);
+	Args.SetNum(Num.Y, false);
+	for (int32 x = 0; x < Num.X; x++)
+	{
+		for (int32 y = 0; y < Num.Y; y++) F[y] = (Seeds[y * Num.X + x] >= 0) ? 0.0f : RoadFieldNone;
+		RoadFieldTransform1D(F, D, Args, V, Z);
+		for (int32 y = 0; y < Num.Y; y++)
+		{
+			ColumnDist[y * Num.X + x] = D[y];
+			ColumnSeed[y * Num.X + x] = (Args[y] >= 0) ? Seeds[Args[y] * Num.X + x] : -1;
+		}
+	}
+
+	// rows. picks the column whose seed is closest overall.
+	F.SetNum(Num.X, false);
+	D.SetNum(Num.X, false);
+	Args.SetNum(Num.X, false);
+	for (int32 y = 0; y < Num.Y; y++)
+	{
+		for (int32 x = 0; x < Num.X; x++) F[x] = ColumnDist[y * Num.X + x];
+		RoadFieldTransform1D(F, D, Args, V, Z);
+
+		for (int32 x = 0; x < Num.X; x++)
+		{
+			if (Args[x] < 0) continue;
+			int32 Seed = ColumnSeed[y * Num.X + Args[x]];
+			if (Seed < 0) continue;
+
+			// exact distance to the point itself, not to its sample.
+			const FVector& Point = Points[Seed];
+			FVector2D Pos = FVector2D(Min.X + x, Min.Y + y) * Spacing;
+			Distances[y * Num.X + x] = FVector2D::Distance(FVector2D(Point.X, Point.Y), Pos);
+			RoadHeights[y * Num.X + x] = Point.Z;
+		}
+	}
+}
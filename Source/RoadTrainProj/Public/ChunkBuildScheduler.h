@@ -0,0 +1,94 @@
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+
+#include <atomic>
+
+class FChunkBuildWorker;
+
+// persistent threads for chunk builds. one queue for all workers, lowest priority value pops first.
+// one job per chunk at a time. chunk stays in flight until its job drops it or Release is called.
+class FChunkBuildScheduler
+{
+	friend FChunkBuildWorker;
+
+public:
+	// returns false if it dropped its chunk (stale), true if it handed a result off.
+	typedef TUniqueFunction<bool()> FJobWork;
+
+	FChunkBuildScheduler(const int32& WorkerNum, const EThreadPriority& Priority);
+	~FChunkBuildScheduler();
+
+	// thread safe. false if the chunk is already in flight.
+	// lower Priority runs first, same Priority runs in enqueue order.
+	bool Enqueue(const FIntPoint& Chunk, const float& Priority, FJobWork&& Work);
+	// thread safe. puts the chunk in flight without a job, for results made elsewhere. false if it already is.
+	bool TryReserve(const FIntPoint& Chunk);
+	// thread safe. chunk's result is used (or thrown away), so it can be built again.
+	void Release(const FIntPoint& Chunk);
+	bool IsInFlight(const FIntPoint& Chunk);
+
+	// game thread. once per frame.
+	void UpdateStats();
+
+	int32 GetWorkerNum() const { return Workers.Num(); }
+	int32 GetQueueDepth() const { return QueueDepth; }
+	float GetAverageLatencyMs() const { return AverageLatencyMs; }
+	float GetUtilization() const { return Utilization; }
+
+private:
+	struct FJob
+	{
+		FIntPoint Chunk;
+		float Priority;
+		uint64 Sequence;
+		double EnqueueTime;
+		FJobWork Work;
+	};
+
+	// binary heap. O(log n) push & pop, top is the most wanted job of every pass.
+	FCriticalSection JobsMutex;
+	TArray<FJob> Jobs;
+	uint64 NextSequence = 0;
+
+	TArray<TUniquePtr<FChunkBuildWorker>> Workers;
+
+	FCriticalSection InFlightMutex;
+	TSet<FIntPoint> InFlight;
+
+	std::atomic<uint32> NextWorker;
+	std::atomic<int32> QueueDepth;
+	std::atomic<uint64> BusyCycles;
+
+	FCriticalSection LatencyMutex;
+	float AverageLatencyMs = 0.0f;
+
+	// game thread only.
+	float Utilization = 0.0f;
+	uint64 LastStatsCycles = 0;
+	uint64 LastBusyCycles = 0;
+
+	bool PopJob(FJob& OutJob);
+	void RunJob(FJob& Job);
+};
+
+class FChunkBuildWorker : public FRunnable
+{
+public:
+	FChunkBuildWorker(FChunkBuildScheduler* pScheduler, const int32& Index, const EThreadPriority& Priority);
+	~FChunkBuildWorker();
+
+	void Wake();
+
+private:
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+	FChunkBuildScheduler* pScheduler;
+	int32 Index;
+	FEvent* WorkEvent;
+	std::atomic<bool> ShouldStop;
+	FRunnableThread* Thread;
+};
@@ -6,9 +6,28 @@
 #include "RealtimeMeshSimple.h"         // RealtimeMesh namespace
 #include "Mesh/RealtimeMeshAlgo.h"      // RealtimeMeshAlgo
 
+#include <atomic>
+
 struct FPerlinNoiseVariables;
+struct FHeightTile;
+struct FRoadField;
 class ALandscapeManager;
 
+// index list nobody writes to after it's made. made once per LOD instead of once per build.
+// every stream set still gets its own copy of it, RealtimeMesh has no index buffer shared between meshes.
+typedef TSharedPtr<const TArray<uint32>, ESPMode::ThreadSafe> FTrianglesPtr;
+
+// one chunk's mesh before it's packed into a stream set. base grid triangles aren't in it, they come from LOD.
+struct FChunkMeshView
+{
+	int32 LOD = 0;
+	TConstArrayView<FVector3f> Vertices;
+	TConstArrayView<FVector3f> Tangents;
+	TConstArrayView<FVector3f> Normals;
+	TConstArrayView<FVector2DHalf> UVs;
+	TConstArrayView<uint32> Triangles;	// path layer, after the base grid ones.
+};
+
 class FChunkBuilder
 {
 	friend ALandscapeManager; // debug
@@ -36,12 +55,27 @@ public:
 	    UMaterialInterface* ChunkMaterial;
     
 
-	void GetStreamSet(const FIntPoint& Chunk, const TArray<FVector>& InPath, RealtimeMesh::FRealtimeMeshStreamSet& OutStreamSet);
+	// LOD 0 is full density, every level up halves it. path layer is only made on LOD 0.
+	// returns bytes OutStreamSet holds. OutMesh points into this thread's scratch, good until its next build.
+	int32 GetStreamSet(const FIntPoint& Chunk, const TArray<FVector>& InPath, RealtimeMesh::FRealtimeMeshStreamSet& OutStreamSet, const int32& LOD = 0, FChunkMeshView* OutMesh = nullptr);
+	// packs a mesh made before. (disk cache) thread safe.
+	int32 GetStreamSet(const FChunkMeshView& Mesh, RealtimeMesh::FRealtimeMeshStreamSet& OutStreamSet);
+	// far field. one low res grid around Center, open where the streamed chunks are. thread safe.
+	void GetHorizonStreamSet(const FIntPoint& Center, const int32& HoleRadius, RealtimeMesh::FRealtimeMeshStreamSet& OutStreamSet);
 
 	//void GetStreamSet(const FIntPoint& Chunk, RealtimeMesh::FRealtimeMeshStreamSet& OutStreamSet);
 	//void GetPathStreamSet(const FIntPoint& Chunk, const TArray<FVector>& InPath, const TSet<FIntPoint> NoBuildChunks, RealtimeMesh::FRealtimeMeshStreamSet& OutStreamSet);
 
     float GetHeight( const FVector2D& Location );
+	// batch version of GetHeight. fills Count.X * Count.Y heights row by row.
+	// sample (i, j) is at Origin + (StartIndex + (i, j)) * Spacing, same math as GetVertices.
+	void GetHeights(const FVector2D& Origin, const float& Spacing, const FIntPoint& StartIndex, const FIntPoint& Count, TArray<float>& OutHeights);
+	// batch version of GetHeight for scattered locations.
+	void GetHeights(const TArray<FVector2D>& Locations, TArray<float>& OutHeights);
+
+	// stream set size of the last full detail chunk, and how much the compact layout saved on it.
+	std::atomic<int32> LastChunkBytes = 0;
+	std::atomic<int32> LastChunkSavedBytes = 0;
 
 private:
 	// for debugging & reusing purposes, shown on editor details pannel
@@ -50,26 +84,55 @@ private:
 	UPROPERTY( VisibleAnywhere, Category = "Chunks", meta = (DisplayPriority = 6) )
 	    float ChunkLength;
 
+	ALandscapeManager* pLM; // don't change member values!!
 	int32 CoverageRad;
 	int32 DetailCount;
+	int32 SmoothRadius;
+	int32 MaxLOD;		// 0 -> no LOD rings, no skirts.
+	float SkirtDepth;
+	int32 HorizonChunks;
+	int32 HorizonCellsPerChunk;
+	float HorizonDrop;
+	bool UseCompactLayout;	// 16 bit indices if they fit, no color & polygroup streams.
+
+	// grid (+ skirt) topology per LOD. VerticesPerChunk & MaxLOD don't change, so LOD is enough for a key.
+	FCriticalSection BaseTrianglesMutex;
+	TMap<int32, FTrianglesPtr> BaseTriangles;
+	FTrianglesPtr GetBaseTriangles(const int32& LOD);
+
+	// false if SIMD noise failed the self check on construction. falls back to scalar GetHeight.
+	bool UseBatchHeight = true;
+	bool CheckBatchHeight();
 
 
     // tools below.
 	void GetStreamSetComponents(const FIntPoint& Chunk, 
+		TArray<FVector3f>& Vertices, TArray<FVector3f>& Tangents, TArray<FVector3f>& Normals, TArray<FVector2DHalf>& UVs);
+	void GetLODStreamSetComponents(const FIntPoint& Chunk, const int32& LOD,
+		TArray<FVector3f>& Vertices, TArray<FVector3f>& Tangents, TArray<FVector3f>& Normals, TArray<FVector2DHalf>& UVs);
+	void AddSkirts(const int32& VertexCount, 
+		TArray<FVector3f>& Vertices, TArray<FVector3f>& Tangents, TArray<FVector3f>& Normals, TArray<FVector2DHalf>& UVs);
+	void AddSkirtTriangles(const int32& VertexCount, TArray<uint32>& Triangles);
+	void GetBorder(const int32& VertexCount, TArray<int32>& OutBorder);
+	void GetLODCoords(const int32& LOD, TArray<int32>& OutCoords);
+	int32 GetLODVertexCount(const int32& LOD);
+	void MakeRoadField(const FIntPoint& Chunk, const TArray<FVector>& InPath, FRoadField& OutField);
+	void GetPathStreamSetComponents(const FIntPoint& Chunk, const FRoadField& Field,
 		TArray<FVector3f>& Vertices, TArray<FVector3f>& Tangents, TArray<FVector3f>& Normals, TArray<uint32>& Triangles, TArray<FVector2DHalf>& UVs);
-	void GetPathStreamSetComponents(const FIntPoint& Chunk, const TArray<FVector>& InPath,
-		TArray<FVector3f>& Vertices, TArray<FVector3f>& Tangents, TArray<FVector3f>& Normals, TArray<uint32>& Triangles, TArray<FVector2DHalf>& UVs);
-	void BuildStreamSet(TArray<FVector3f>& Vertices, TArray<FVector3f>& Tangents, TArray<FVector3f>& Normals, TArray<uint32>& Triangles, TArray<FVector2DHalf>& UVs, 
-		RealtimeMesh::FRealtimeMeshStreamSet& OutStreamSet);
+	void BuildStreamSet(TConstArrayView<FVector3f> Vertices, TConstArrayView<FVector3f> Tangents, TConstArrayView<FVector3f> Normals, TConstArrayView<uint32> Triangles, TConstArrayView<FVector2DHalf> UVs, 
+		RealtimeMesh::FRealtimeMeshStreamSet& OutStreamSet, const TArray<uint32>* BaseTriangles = nullptr);
+	template<typename IndexType>
+	void BuildStreams(TConstArrayView<FVector3f> Vertices, TConstArrayView<FVector3f> Tangents, TConstArrayView<FVector3f> Normals, TConstArrayView<uint32> Triangles, TConstArrayView<FVector2DHalf> UVs,
+		const TArray<uint32>* BaseTriangles, const bool& Compact, RealtimeMesh::FRealtimeMeshStreamSet& OutStreamSet);
+	bool IsCompact(const int32& VertexNum);
+	int32 GetMeshBytes(const int32& VertexNum, const int32& IndexNum, const bool& Compact);
 
-	void LowerVerticesNearPath(const FIntPoint& Chunk, const TArray<FVector>& InPath, TArray<FVector3f>& Vertices);
+	void LowerVerticesNearPath(const FIntPoint& Chunk, const FRoadField& Field, TArray<FVector3f>& Vertices);
 
-    void GetVertices( const FIntPoint& Chunk, const int32& StartIndex, const int32& EndIndex, const int32& VertexSpace, TArray<FVector3f>& OutVertices );
+    void GetVertices( const FHeightTile& Tile, const int32& StartIndex, const int32& EndIndex, const int32& VertexSpace, TArray<FVector3f>& OutVertices );
     void GetUVs( const FIntPoint& Chunk, const int32& StartIndex, const int32& EndIndex, const float& UVscale, TArray<FVector2DHalf>& OutUVs );
     void GetTriangles( const int32& VertexCount, TArray<uint32>& OutTriangles );
-    void GetTangents(  const int32& VertexCount, const TArray<uint32>& BigTriangles, const TArray<FVector3f>& BigVertices, 
-                            TArray<FVector3f>& OutTangents, TArray<FVector3f>& OutNormals );
-	void GetBigVertices(const FIntPoint& Chunk, const TArray<FVector3f>& SmallVertices, TArray<FVector3f>& OutVertices);
+	void GetTangents(const FHeightTile& Tile, const TArray<int32>& Coords, TArray<FVector3f>& OutTangents, TArray<FVector3f>& OutNormals);
 	void MakeSquare(const int32& Index, const int32& CurrentVertex, const int32& VertexCount, TArray<uint32>& OutTriangles, bool Invert = true);
 	
 	int32 GetIndex(const int32& VertexCount, const FIntPoint& Pos);
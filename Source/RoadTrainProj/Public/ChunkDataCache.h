@@ -0,0 +1,73 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/LruCache.h"	// LRU eviction
+
+#include <atomic>
+
+class ALandscapeManager;
+struct FChunkMeshView;
+
+// key of a finished chunk build. same chunk, same LOD & same roads nearby -> same mesh.
+struct FChunkDataKey
+{
+	FChunkDataKey() {};
+	FChunkDataKey(const FIntPoint& Chunk, const int32& LOD, const uint32& PathVersion) : Chunk(Chunk), LOD(LOD), PathVersion(PathVersion) {};
+
+	FIntPoint Chunk;
+	int32 LOD = 0;
+	uint32 PathVersion = 0;	// hash of the gates (+ entry directions) the chunk's roads come from.
+
+	bool operator==(const FChunkDataKey& Other) const { return Chunk == Other.Chunk && LOD == Other.LOD && PathVersion == Other.PathVersion; }
+	friend uint32 GetTypeHash(const FChunkDataKey& Key) { return HashCombine(HashCombine(GetTypeHash(Key.Chunk), GetTypeHash(Key.LOD)), Key.PathVersion); }
+};
+
+// one finished chunk, as the raw mesh arrays the disk cache keeps. packed into a stream set only when it's used again.
+struct FCachedChunk
+{
+	int32 LOD = 0;
+	TArray<FVector3f> Vertices;
+	TArray<FVector3f> Tangents;
+	TArray<FVector3f> Normals;
+	TArray<FVector2DHalf> UVs;
+	TArray<uint32> Triangles;	// path layer only. base grid ones come from LOD.
+	TArray<FVector> ActualPath;
+
+	FChunkMeshView GetView() const;
+};
+
+typedef TSharedPtr<const FCachedChunk, ESPMode::ThreadSafe> FCachedChunkPtr;
+
+// finished chunk builds, kept after the chunk is dropped. thread safe.
+// chunks we drive back into come from here instead of noise, paths & meshing. least recently used go first over budget.
+// the build's own stream set goes to the mesh untouched, only the raw arrays are copied in here.
+class FChunkDataCache
+{
+
+public:
+	FChunkDataCache(ALandscapeManager* pLM);
+
+	// the cached chunk itself, never changed after Add. nullptr if it's not there.
+	// pack it with FChunkBuilder::GetStreamSet(GetView(), ...). (worker, never game thread)
+	FCachedChunkPtr Find(const FChunkDataKey& Key);
+	// copies Mesh & ActualPath. Mesh can point at builder scratch or a mapped file.
+	void Add(const FChunkDataKey& Key, const FChunkMeshView& Mesh, const TArray<FVector>& ActualPath);
+	void Empty();
+
+	int32 GetHitCount() const { return HitCount; }
+	int32 GetMissCount() const { return MissCount; }
+	SIZE_T GetBytes();
+
+private:
+
+	SIZE_T BudgetBytes;
+
+	FCriticalSection Mutex;
+	TLruCache<FChunkDataKey, FCachedChunkPtr> Entries;
+	SIZE_T Bytes = 0;
+
+	std::atomic<int32> HitCount;
+	std::atomic<int32> MissCount;
+
+	static SIZE_T GetEntryBytes(const FCachedChunk& Data);
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "Containers/Queue.h"
+#include "Containers/LruCache.h"	// LRU eviction
+
+#include <atomic>
+
+class ALandscapeManager;
+class FChunkBuilder;
+struct FChunkData;
+struct FChunkDataKey;
+struct FChunkMeshView;
+class FChunkDataCache;
+
+// finished chunks on disk, one file per chunk under Saved/ChunkCache/<ParamHash>/. thread safe.
+// files are memory mapped on load, the mesh goes from the mapping straight into the stream set.
+// writes go through one background thread. least recently used files are deleted over budget,
+// folders of other ParamHashes are deleted on start.
+// file: FChunkFileHeader, then ActualPath (FVector), Vertices, Tangents, Normals (FVector3f), Triangles (uint32), UVs (FVector2DHalf).
+class FChunkDiskCache : public FRunnable
+{
+
+public:
+	FChunkDiskCache(ALandscapeManager* pLM);
+	// writes still queued are thrown away.
+	~FChunkDiskCache();
+
+	// false if there's no file, or it's from another format / other params.
+	// MemoryCache gets the mesh too, straight from the mapping.
+	bool Load(const FChunkDataKey& Key, FChunkBuilder& Builder, FChunkData& OutData, FChunkDataCache* MemoryCache = nullptr);
+	// copies Mesh & ActualPath, the file is written later on the writer thread.
+	void Save(const FChunkDataKey& Key, const FChunkMeshView& Mesh, const TArray<FVector>& ActualPath);
+
+	int32 GetHitCount() const { return HitCount; }
+	int32 GetMissCount() const { return MissCount; }
+	int64 GetBytes();
+
+private:
+
+	FString Directory;
+	uint32 ParamHash;
+	int64 BudgetBytes;
+
+	std::atomic<int32> HitCount;
+	std::atomic<int32> MissCount;
+
+	// file names (no path) in Directory -> size. recently written or loaded ones are kept.
+	FCriticalSection FilesMutex;
+	TLruCache<FString, int64> Files;
+	int64 Bytes = 0;
+
+	struct FWrite
+	{
+		FString Filename;
+		TArray<uint8> Data;	// whole file.
+	};
+
+	TQueue<FWrite, EQueueMode::Mpsc> Writes;
+	std::atomic<int64> PendingBytes;	// queued, not written yet. new ones are dropped over MaxPendingBytes.
+
+	FEvent* WorkEvent;
+	std::atomic<bool> ShouldStop;
+	FRunnableThread* Thread;
+
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+	void Write(FWrite& Job);
+	void RemoveStaleDirectories();
+	void ScanFiles();
+
+	FString GetFilename(const FChunkDataKey& Key);
+	uint32 GetParamHash(ALandscapeManager* pLM);
+};
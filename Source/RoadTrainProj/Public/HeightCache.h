@@ -0,0 +1,88 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/LruCache.h"	// LRU eviction
+
+#include <atomic>
+
+class ALandscapeManager;
+
+// heights of one chunk, with one vertex / one cell border for seamless normals & gate edges.
+// never changed after it's made, so every thread can read it without locks.
+struct FHeightTile
+{
+	FIntPoint Chunk;
+	int32 VertexRow;	// VerticesPerChunk + 2. local vertex -1 ~ VerticesPerChunk
+	int32 CellRow;		// VerticesPerChunk + 1. local cell -1 ~ VerticesPerChunk - 1
+
+	TArray<float> VertexHeights;	// height on vertex (grid corner)
+	TArray<float> CellHeights;		// height on cell center (same as FPathFinder::GetCellHeight)
+
+	float GetVertexHeight(const FIntPoint& LocalVertex) const
+	{
+		return VertexHeights[(LocalVertex.Y + 1) * VertexRow + (LocalVertex.X + 1)];
+	}
+
+	bool HasCell(const FIntPoint& LocalCell) const
+	{
+		return LocalCell.X >= -1 && LocalCell.X < CellRow - 1 && LocalCell.Y >= -1 && LocalCell.Y < CellRow - 1;
+	}
+
+	float GetCellHeight(const FIntPoint& LocalCell) const
+	{
+		return CellHeights[(LocalCell.Y + 1) * CellRow + (LocalCell.X + 1)];
+	}
+
+	SIZE_T GetAllocatedSize() const
+	{
+		return sizeof(FHeightTile) + VertexHeights.GetAllocatedSize() + CellHeights.GetAllocatedSize();
+	}
+};
+
+typedef TSharedPtr<const FHeightTile, ESPMode::ThreadSafe> FHeightTilePtr;
+
+// chunk + noise setting. tiles made with old noise layers never match.
+struct FHeightTileKey
+{
+	FHeightTileKey() {};
+	FHeightTileKey(const FIntPoint& Chunk, const uint32& ParamHash) : Chunk(Chunk), ParamHash(ParamHash) {};
+
+	FIntPoint Chunk;
+	uint32 ParamHash = 0;
+
+	bool operator==(const FHeightTileKey& Other) const { return Chunk == Other.Chunk && ParamHash == Other.ParamHash; }
+	friend uint32 GetTypeHash(const FHeightTileKey& Key) { return HashCombine(GetTypeHash(Key.Chunk), Key.ParamHash); }
+};
+
+// shared heightfield cache for ChunkBuilder & PathFinder. thread safe.
+// tiles are filled once, then only read. least recently used ones go first when over budget.
+class FHeightCache
+{
+
+public:
+	FHeightCache(ALandscapeManager* pLM);
+
+	// returns filled tile. builds it on the calling thread if missing.
+	FHeightTilePtr GetTile(const FIntPoint& Chunk);
+	void Empty();
+
+	int32 GetHitCount() const { return HitCount; }
+	int32 GetMissCount() const { return MissCount; }
+
+private:
+
+	ALandscapeManager* pLM; // don't change member values!!
+	int32 VerticesPerChunk;
+	float VertexSpacing;
+	float ChunkLength;
+	uint32 ParamHash;
+
+	FCriticalSection Mutex;
+	TLruCache<FHeightTileKey, FHeightTilePtr> Tiles;
+
+	std::atomic<int32> HitCount;
+	std::atomic<int32> MissCount;
+
+	FHeightTilePtr BuildTile(const FIntPoint& Chunk);
+	uint32 GetParamHash();
+};
@@ -10,31 +10,48 @@
 
 #include "PathFinder.h"
 #include "ChunkBuilder.h"
+#include "HeightCache.h"
+#include "ChunkDataCache.h"
+#include "ChunkDiskCache.h"
+#include "ChunkBuildScheduler.h"
+#include "PathService.h"
+
+#include <atomic>
 
 #include "LandscapeManager.generated.h"
 
 
 // delegates
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FEventDispatcher);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FSpawnPosDispatcher, FVector, SpawnPos);
 
 struct FPerlinNoiseVariables;
 class USplineComponent;
-class FPathWorker;
 struct FChunkData;
+struct FHorizonData;
+
+// thread priority of chunk build workers. keep it low so vehicle physics gets its cores.
+UENUM()
+enum class EChunkBuildPriority : uint8
+{
+    Normal,
+    BelowNormal,
+    Lowest
+};
 
 UCLASS()
 class ROADTRAINPROJ_API ALandscapeManager : public AActor
 {
     GENERATED_BODY()
 
-    friend FPathWorker;
-
 public:
     ALandscapeManager();
     
     virtual void OnConstruction(const FTransform &Transform) override;
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
+    virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+    virtual void BeginDestroy() override;
 
 protected:
 	// Called when the game starts or when spawned
@@ -47,30 +64,151 @@ public:
 	UPROPERTY( EditAnywhere, Category = "Terrain", meta = (DisplayPriority = 2, ClampMin = "2", Step = "2") )
 	    int32 VerticesPerChunk = 128;
 	UPROPERTY( EditAnywhere, Category = "Terrain", meta = (DisplayPriority = 3, ClampMin = "0", Step = "1") )
-	    int32 ChunkRadius = 2;
+	    int32 ChunkRadius = 2;  // radius when standing still. runtime radius is ActiveChunkRadius.
 	UPROPERTY( EditAnywhere, Category = "Terrain", meta = (DisplayPriority = 4, ClampMin = "0.0", Step = "10.0") )
 	    float TextureSize = 300.0f;
     UPROPERTY(EditAnywhere, Category = "Terrain|Coverage", meta = (DisplayPriority = 1, ClampMin = "0", Step = "1"))
         int32 CoverageRadius;   // cover radius of detailed layer.
     UPROPERTY( EditAnywhere, Category = "Terrain|Coverage", meta = (DisplayPriority = 2, ClampMin = "0", Step = "1"))
         int32 DetailCount;  // num of mesh squares in one side of detail layer. should divide VertexSpacing right.
+    // box smoothing radius on the detail layer, in detail vertices. 0 -> CoverageRadius. cost doesn't grow with it.
+    // at most CoverageRadius * DetailCount, the layer's half width. only full boxes are smoothed, a wider one never is.
+    // clamped in OnConstruction & BeginPlay, ClampMax can't follow the other two.
+    UPROPERTY( EditAnywhere, Category = "Terrain|Coverage", meta = (DisplayPriority = 3, ClampMin = "0", Step = "1"))
+        int32 RoadSmoothRadius = 0;
     UPROPERTY( EditAnywhere, Category = "Terrain|Height", meta = (DisplayPriority = 1) )
 	    bool ShouldGenerateHeight = true;
     UPROPERTY( EditAnywhere, Category = "Terrain|Height", meta = (DisplayPriority = 2) )
 	    TArray<FPerlinNoiseVariables> NoiseLayers;
+    // noise offsets from Seed instead of random. same world every launch.
+    UPROPERTY( EditAnywhere, Category = "Terrain|Height", meta = (DisplayPriority = 3) )
+        bool UseSeed = false;
+    UPROPERTY( EditAnywhere, Category = "Terrain|Height", meta = (DisplayPriority = 4, EditCondition = "UseSeed") )
+        int32 Seed = 1;
 
     UPROPERTY( EditAnywhere, Category = "Terrain|Material", meta = (DisplayPriority = 1) )
         UMaterialInterface* Material;
 
+    // 16 bit indices when a chunk fits, no vertex color & polygroup streams. the material can't read vertex color with it.
+    UPROPERTY( EditAnywhere, Category = "Terrain|Mesh", meta = (DisplayPriority = 1) )
+        bool UseCompactLayout = true;
+    // last full detail chunk. (read only)
+    UPROPERTY( VisibleAnywhere, Transient, Category = "Terrain|Mesh", meta = (DisplayPriority = 2, Units = "Kilobytes") )
+        float LastChunkMeshKB = 0.0f;
+    UPROPERTY( VisibleAnywhere, Transient, Category = "Terrain|Mesh", meta = (DisplayPriority = 3, Units = "Kilobytes") )
+        float LastChunkSavedKB = 0.0f;
+
+    // memory for cached height tiles shared by ChunkBuilder & PathFinder.
+    UPROPERTY( EditAnywhere, Category = "Terrain|Cache", meta = (DisplayPriority = 1, ClampMin = "1", Units = "MB") )
+        int32 HeightCacheBudgetMB = 64;
+    // recycled chunk actors. (read only)
+    UPROPERTY( VisibleAnywhere, Transient, Category = "Terrain|Cache", meta = (DisplayPriority = 2) )
+        int32 PoolHitCount = 0;
+    UPROPERTY( VisibleAnywhere, Transient, Category = "Terrain|Cache", meta = (DisplayPriority = 3) )
+        int32 PoolMissCount = 0;
+    // finished chunks kept after they're dropped, for driving back. 0 -> off.
+    UPROPERTY( EditAnywhere, Category = "Terrain|Cache", meta = (DisplayPriority = 4, ClampMin = "0", Units = "MB") )
+        int32 ChunkDataCacheBudgetMB = 256;
+    UPROPERTY( VisibleAnywhere, Transient, Category = "Terrain|Cache", meta = (DisplayPriority = 5, Units = "Percent") )
+        float ChunkDataCacheHitRate = 0.0f;
+    UPROPERTY( VisibleAnywhere, Transient, Category = "Terrain|Cache", meta = (DisplayPriority = 6, Units = "Megabytes") )
+        float ChunkDataCacheMB = 0.0f;
+    // finished chunks saved under Saved/ChunkCache and loaded on later launches. needs UseSeed.
+    UPROPERTY( EditAnywhere, Category = "Terrain|Cache", meta = (DisplayPriority = 7, EditCondition = "UseSeed") )
+        bool UseDiskCache = false;
+    UPROPERTY( VisibleAnywhere, Transient, Category = "Terrain|Cache", meta = (DisplayPriority = 8, Units = "Percent") )
+        float DiskCacheHitRate = 0.0f;
+    // least recently used chunk files are deleted past this.
+    UPROPERTY( EditAnywhere, Category = "Terrain|Cache", meta = (DisplayPriority = 9, ClampMin = "1", Units = "MB", EditCondition = "UseDiskCache") )
+        int32 DiskCacheBudgetMB = 2048;
+    UPROPERTY( VisibleAnywhere, Transient, Category = "Terrain|Cache", meta = (DisplayPriority = 10, Units = "Megabytes") )
+        float DiskCacheMB = 0.0f;
+
     UPROPERTY(EditAnywhere, Category = "Terrain|Async", meta = (DisplayPriority = 0))
         bool UseAsync;
 
     // Wait how many frames before updating chunks after playerlocated chunk changed.
     UPROPERTY( EditAnywhere, Category = "Terrain|Async", meta = (DisplayPriority = 1) )
         int32 UpdateDelayFrames;
-    // Update chunk when the amount of frames change.
-    UPROPERTY(EditAnywhere, Category = "Terrain|Async", meta = (DisplayPriority = 1))
-        int32 DoWorkFrame;
+    // game thread time for adding & removing chunks per frame. at least one item is done every frame.
+    UPROPERTY(EditAnywhere, Category = "Terrain|Async", meta = (DisplayPriority = 2, ClampMin = "0.1", Units = "ms"))
+        float IntegrationBudgetMs = 2.0f;
+    // measured. (read only)
+    UPROPERTY(VisibleAnywhere, Transient, Category = "Terrain|Async", meta = (DisplayPriority = 3, Units = "ms"))
+        float LastIntegrationMs = 0.0f;
+    UPROPERTY(VisibleAnywhere, Transient, Category = "Terrain|Async", meta = (DisplayPriority = 4))
+        int32 LastIntegrationItems = 0;
+    UPROPERTY(VisibleAnywhere, Transient, Category = "Terrain|Async", meta = (DisplayPriority = 5, Units = "ms"))
+        float AverageAddChunkMs = 0.0f;
+    UPROPERTY(VisibleAnywhere, Transient, Category = "Terrain|Async", meta = (DisplayPriority = 6, Units = "ms"))
+        float AverageRemoveChunkMs = 0.0f;
+    // chunk build threads. 0 -> cores - 2.
+    UPROPERTY(EditAnywhere, Category = "Terrain|Async", meta = (DisplayPriority = 7, ClampMin = "0"))
+        int32 ChunkBuildWorkers = 0;
+    UPROPERTY(EditAnywhere, Category = "Terrain|Async", meta = (DisplayPriority = 8))
+        EChunkBuildPriority ChunkBuildPriority = EChunkBuildPriority::BelowNormal;
+
+    // build order. priority = distance (chunks) - heading bonus - gate path bonus. lower builds first.
+    // heading bonus in chunks, at full speed. scales with speed.
+    UPROPERTY(EditAnywhere, Category = "Terrain|Priority", meta = (DisplayPriority = 1, ClampMin = "0.0"))
+        float HeadingWeight = 2.0f;
+    // bonus in chunks for chunks on GatePath.
+    UPROPERTY(EditAnywhere, Category = "Terrain|Priority", meta = (DisplayPriority = 2, ClampMin = "0.0"))
+        float GatePathWeight = 1.0f;
+    // chunks ahead we'll reach in this time are built beyond ChunkRadius.
+    UPROPERTY(EditAnywhere, Category = "Terrain|Priority", meta = (DisplayPriority = 3, ClampMin = "0.0", Units = "s"))
+        float PrefetchSeconds = 4.0f;
+    UPROPERTY(EditAnywhere, Category = "Terrain|Priority", meta = (DisplayPriority = 4, ClampMin = "0", ClampMax = "8"))
+        int32 MaxPrefetchChunks = 2;
+
+    // streaming radius at runtime. ChunkRadius + one ring per SpeedPerRing, smaller if frames get slow.
+    UPROPERTY(EditAnywhere, Category = "Terrain|Radius", meta = (DisplayPriority = 1, ClampMin = "0"))
+        int32 MinChunkRadius = 1;
+    UPROPERTY(EditAnywhere, Category = "Terrain|Radius", meta = (DisplayPriority = 2, ClampMin = "0", ClampMax = "16"))
+        int32 MaxChunkRadius = 5;
+    UPROPERTY(EditAnywhere, Category = "Terrain|Radius", meta = (DisplayPriority = 3, ClampMin = "100.0", Units = "CentimetersPerSecond"))
+        float SpeedPerRing = 1000.0f;
+    UPROPERTY(EditAnywhere, Category = "Terrain|Radius", meta = (DisplayPriority = 4, ClampMin = "1.0", Units = "ms"))
+        float TargetFrameMs = 16.6f;
+    // dead band around every threshold (speed & frame time), so radius doesn't flip at the edge.
+    UPROPERTY(EditAnywhere, Category = "Terrain|Radius", meta = (DisplayPriority = 5, ClampMin = "0.0", ClampMax = "0.9"))
+        float RadiusHysteresis = 0.15f;
+    // min time between two radius changes.
+    UPROPERTY(EditAnywhere, Category = "Terrain|Radius", meta = (DisplayPriority = 6, ClampMin = "0.0", Units = "s"))
+        float RadiusCooldown = 2.0f;
+    UPROPERTY(VisibleAnywhere, Transient, Category = "Terrain|Radius", meta = (DisplayPriority = 7))
+        int32 CurrentChunkRadius = 0;
+
+    // outer rings use 1/2, 1/4, 1/8 of VerticesPerChunk. 0 -> every chunk full density.
+    UPROPERTY(EditAnywhere, Category = "Terrain|LOD", meta = (DisplayPriority = 1, ClampMin = "0", ClampMax = "3"))
+        int32 MaxChunkLOD = 3;
+    // rings around the truck kept at full density. roads are only made on these.
+    UPROPERTY(EditAnywhere, Category = "Terrain|LOD", meta = (DisplayPriority = 2, ClampMin = "1"))
+        int32 FullDetailRadius = 2;
+    // rings per LOD level out of FullDetailRadius.
+    UPROPERTY(EditAnywhere, Category = "Terrain|LOD", meta = (DisplayPriority = 3, ClampMin = "1"))
+        int32 LODRingWidth = 1;
+    // skirts on chunk borders hide cracks between LOD levels.
+    UPROPERTY(EditAnywhere, Category = "Terrain|LOD", meta = (DisplayPriority = 4, ClampMin = "0.0", Units = "cm"))
+        float LODSkirtDepth = 3000.0f;
+
+    // one low res mesh out to HorizonChunks, so there's no visible edge past the streamed chunks.
+    UPROPERTY(EditAnywhere, Category = "Terrain|Horizon", meta = (DisplayPriority = 1))
+        bool ShowHorizon = true;
+    // 16 chunks is about 20km each way at default chunk size.
+    UPROPERTY(EditAnywhere, Category = "Terrain|Horizon", meta = (DisplayPriority = 2, ClampMin = "1", ClampMax = "64"))
+        int32 HorizonChunks = 16;
+    UPROPERTY(EditAnywhere, Category = "Terrain|Horizon", meta = (DisplayPriority = 3, ClampMin = "1", ClampMax = "16"))
+        int32 HorizonCellsPerChunk = 4;
+    // rebuilt around the truck after it moved this many chunks from the last center. (or when the streamed radius changes)
+    // at most ActiveChunkRadius - 1, the hole is what's left of the streamed radius after this slack.
+    UPROPERTY(EditAnywhere, Category = "Terrain|Horizon", meta = (DisplayPriority = 4, ClampMin = "1"))
+        int32 HorizonRecenterChunks = 2;
+    // kept under the streamed chunks where they overlap.
+    UPROPERTY(EditAnywhere, Category = "Terrain|Horizon", meta = (DisplayPriority = 5, ClampMin = "0.0", Units = "cm"))
+        float HorizonDrop = 2000.0f;
+    UPROPERTY(VisibleAnywhere, Transient, Category = "Terrain|Horizon", meta = (DisplayPriority = 6, Units = "ms"))
+        float LastHorizonBuildMs = 0.0f;
 
     // ----------------Vars for PathFinding--------------------
     UPROPERTY( EditAnywhere, Category = "Path", meta = (DisplayPriority = 1) )
@@ -88,6 +226,20 @@ public:
         int32 CounterHardLock = 20000;
     UPROPERTY(EditAnywhere, Category = "Path", meta = (DisplayPriority = 6))
         bool DrawPathDebug = false;
+    // memory for cached per-chunk traversal costs. (PathFinder)
+    UPROPERTY(EditAnywhere, Category = "Path", meta = (DisplayPriority = 7, ClampMin = "1", Units = "MB"))
+        int32 CostGridBudgetMB = 64;
+    // HPA* entrances on each chunk edge. more finds better routes, but every chunk graph gets bigger.
+    UPROPERTY(EditAnywhere, Category = "Path", meta = (DisplayPriority = 8, ClampMin = "1", ClampMax = "16"))
+        int32 EntrancesPerEdge = 3;
+    // finished roads kept by PathFinder. (gate pair + entry direction)
+    UPROPERTY(EditAnywhere, Category = "Path", meta = (DisplayPriority = 9, ClampMin = "16"))
+        int32 PathCacheSize = 1024;
+    // path service. (read only)
+    UPROPERTY(VisibleAnywhere, Transient, Category = "Path", meta = (DisplayPriority = 10))
+        int32 PathQueueLength = 0;
+    UPROPERTY(VisibleAnywhere, Transient, Category = "Path", meta = (DisplayPriority = 11, Units = "ms"))
+        float PathLatencyMs = 0.0f;
     UPROPERTY( EditAnywhere, Category = "Path|Mesh", meta = (DisplayPriority = 0))
         UStaticMesh* RoadMesh;
     UPROPERTY(EditAnywhere, Category = "Path|Mesh", meta = (DisplayPriority = 1))
@@ -111,18 +263,28 @@ public:
         TArray<USplineComponent*> GetNearSplines();
     UFUNCTION(BluePrintCallable, Category = "Comm")
         bool GetSpawnPos(FVector& OutVector);
+    // same, without blocking. answer comes with OnSpawnPosFound.
+    UFUNCTION(BluePrintCallable, Category = "Comm")
+        void RequestSpawnPos();
 
 
     // Event Dispatcher (Delegate)
     UPROPERTY(BlueprintAssignable, Category = "Events")
     FEventDispatcher OnFirstGenDone;
+    UPROPERTY(BlueprintAssignable, Category = "Events")
+    FSpawnPosDispatcher OnSpawnPosFound;
     
 
-    void AddChunk(const FIntPoint& Chunk, const RealtimeMesh::FRealtimeMeshStreamSet& StreamSet);
+    void AddChunk(const FIntPoint& Chunk, RealtimeMesh::FRealtimeMeshStreamSet&& StreamSet, const int32& LOD = 0);
     bool RemoveChunk(const FIntPoint& Chunk);
+    // swaps mesh of a chunk already in the world. (LOD changed)
+    void UpdateChunk(const FIntPoint& Chunk, RealtimeMesh::FRealtimeMeshStreamSet&& StreamSet, const int32& LOD);
 
     // tools
     float GetHeight(const FVector2D& Location);
+    void GetHeights(const FVector2D& Origin, const float& Spacing, const FIntPoint& StartIndex, const FIntPoint& Count, TArray<float>& OutHeights);
+    void GetHeights(const TArray<FVector2D>& Locations, TArray<float>& OutHeights);
+    FHeightTilePtr GetHeightTile(const FIntPoint& Chunk);
     FVector GridToVector(const FIntPoint& GlobalGrid);
     FIntPoint GetChunk(const FIntPoint& GlobalGrid);
     FIntPoint GetChunk(const FVector& Vector);
@@ -134,12 +296,16 @@ private:
     // ptr for other class.
     std::unique_ptr<FChunkBuilder> ChunkBuilder;
     std::unique_ptr<FPathFinder> PathFinder;
+    std::unique_ptr<FHeightCache> HeightCache;
+    std::unique_ptr<FChunkDataCache> ChunkDataCache;
+    std::unique_ptr<FChunkDiskCache> ChunkDiskCache; // play only, seeded only.
+    std::unique_ptr<FChunkBuildScheduler> ChunkScheduler; // play only.
+    std::unique_ptr<FPathService> PathService; // uses PathFinder, goes before it.
 
 
     //  use it only on game thread
     bool IsPath;
     FIntPoint LastLocation;
-    int32 FrameCounter;
     int32 ShouldWorkCounter;
 
     FRWLock RWGatesMutex;
@@ -150,25 +316,61 @@ private:
 
     //  background thread produces.
     TQueue<FChunkData, EQueueMode::Mpsc>  ChunkQueue;
+
+    // build requests. generation goes up every time BuildCenter moves.
+    // chunks requested but not added yet are in ChunkScheduler's in flight set.
+    FCriticalSection BuildMutex;
+    FIntPoint BuildCenter;
+    FThreadSafeCounter BuildGeneration;
+    TSet<FIntPoint> PrefetchChunks; // wanted out of ChunkRadius. (ahead of the truck)
     //  background thread produces.
 
     FRWLock RWChunksMutex;
     TMap<FIntPoint, ARealtimeMeshActor*> Chunks;
+    TMap<FIntPoint, int32> ChunkLODs;   // LOD each chunk in Chunks was built with.
+
+    // hidden chunk actors waiting for reuse. game thread only.
+    UPROPERTY(Transient)
+        TArray<TObjectPtr<ARealtimeMeshActor>> ChunkPool;
+    void EmptyChunkPool();
+
+    // far field mesh. built on ChunkScheduler under HorizonJobKey, applied on game thread.
+    UPROPERTY(Transient)
+        TObjectPtr<ARealtimeMeshActor> HorizonActor = nullptr;
+    TQueue<FHorizonData, EQueueMode::Mpsc> HorizonQueue;
+    FIntPoint HorizonCenter;
+    int32 HorizonStreamRadius = 0;  // ActiveChunkRadius the horizon was built for.
+    bool IsHorizonMade = false;
+    int32 GetHorizonSlack(const int32& StreamRadius);
+    void UpdateHorizon(const FIntPoint& ChunkNow);
+    void ApplyHorizon(FHorizonData&& HorizonData);
+    void RemoveHorizon();
 
 
     // write only at beginplay. (or onconstruction )
-    TArray<FIntPoint> ChunkOrder;
-    TArray<FIntPoint> BigChunkOrder;
+    // spiral, so the first (2R+1)^2 are radius R. use GetOrderNum for the part in use.
+    TArray<FIntPoint> ChunkOrder;       // MaxChunkRadius
+    TArray<FIntPoint> BigChunkOrder;    // MaxChunkRadius + MaxPrefetchChunks + 1
+
+    // streaming radius now. game thread writes, build workers read.
+    std::atomic<int32> ActiveChunkRadius;
+    float AverageFrameMs = 0.0f;
+    float RadiusChangeTime = 0.0f;
+    void UpdateChunkRadius(const float& DeltaTime);
+    int32 GetOrderNum(const int32& Radius, const TArray<FIntPoint>& Order);
 
     // tools
     void GetChunkOrder(const int32& ChunkRad, TArray<FIntPoint>& OutArray);
     bool IsChunkInRad(const FIntPoint& ChunkNow, const FIntPoint& TargetChunk);
     bool IsChunkInRad(const FIntPoint& ChunkNow, const FIntPoint& TargetChunk, const int32& BoxRadius);
+    int32 GetChunkLOD(const FIntPoint& ChunkNow, const FIntPoint& Chunk);
 
     USplineComponent* AddPathSpline(const FIntPoint& Chunk, const TArray<FVector>& Path);
     void MakeRoad(USplineComponent* Spline);
+    void ClearPathSpline(ARealtimeMeshActor* pRMA);
 
     FVector GetPlayerLocation();
+    FVector GetPlayerVelocity();
     void UpdateGateMap(const int32& StartIndex = 0);
     void UpdateDirMap(const int32& StartIndex = 0);
 
@@ -177,24 +379,29 @@ private:
 
     bool IsFirstGenDone = false;
     
-    // game thread tasks.
+    // game thread tasks. runs until IntegrationBudgetMs is used.
     void Process(const FIntPoint& ChunkNow);
     // part of process.
-    bool FindAndRemoveChunk(const FIntPoint& ChunkNow);
+    bool FindUnwantedChunk(const FIntPoint& ChunkNow, FIntPoint& OutChunk);
     bool DequeueAndAddChunk(const FIntPoint& ChunkNow);
 
 
-    // background thread tasks.
+    // game thread. hands the planning to ChunkScheduler.
     void AsyncWork(const FIntPoint& ChunkNow);
+    // scheduler worker. picks the chunks & queues their builds.
+    void PlanChunks(const FIntPoint& ChunkNow, const FVector& Location, const FVector& Velocity);
 
-    // copy params.
-    void UpdateDataQueue(const TArray<FIntPoint> ChunksNeeded, const TMap<FIntPoint, TPair<FGate, FGate>> NearGatesMap, const TMap<FIntPoint, FVector2D> NearDirMap);
-    FChunkData MakeChunkData(const FIntPoint TargetChunk, const TArray< TPair<FGate, FGate> > NearGates, const TArray<FVector2D> NearDir);
+    // scheduler worker. cached chunks are packed & go straight to ChunkQueue, the rest are scheduled.
+    void UpdateDataQueue(const FIntPoint& ChunkNow, const TArray<TPair<float, FIntPoint>>& ChunksNeeded, const TMap<FIntPoint, TPair<FGate, FGate>>& NearGatesMap, const TMap<FIntPoint, FVector2D>& NearDirMap, const int32& Generation);
+    FChunkData MakeChunkData(const FChunkDataKey& Key, const TArray< TPair<FGate, FGate> >& NearGates, const TArray<FVector2D>& NearDir);
+    uint32 GetPathVersion(const TArray< TPair<FGate, FGate> >& NearGates, const TArray<FVector2D>& NearDir, const int32& LOD);
 
    
     // mutex
     void FindNearGates(const FIntPoint& ChunkNow, TMap<FIntPoint, TPair<FGate, FGate>>& OutGatesMap, TMap<FIntPoint, FVector2D>& OutDirMap);
-    void FindChunksNeeded(const FIntPoint& ChunkNow, TArray<FIntPoint>& OutChunksNeeded);
+    void FindChunksNeeded(const FIntPoint& ChunkNow, const FVector& Location, const FVector& Velocity, const TMap<FIntPoint, TPair<FGate, FGate>>& NearGatesMap, TArray<TPair<float, FIntPoint>>& OutChunksNeeded, TSet<FIntPoint>& OutPrefetch);
+    bool IsBuildStale(const FIntPoint& Chunk, const int32& Generation);
+    bool IsChunkWanted(const FIntPoint& ChunkNow, const FIntPoint& Chunk);
 
     // game thread. checks if work needed.
     bool ShouldDoWork(const FIntPoint& ChunkNow);
@@ -202,52 +409,43 @@ private:
 
     // inf pathfinding stuffs
 
-    std::unique_ptr<FPathWorker> PathWorker;
-    bool UpdatedGoal = false;
+    FPathJobHandle GoalJob;
+    int32 GatePathVersion = 0;  // bumped when GatePath is rebuilt. game thread.
 
     void TryUpdatingGoal(const FIntPoint& ChunkNow);
     bool ShouldUpdateGoal(const FIntPoint& ChunkNow);
+    void CancelGoalUpdate();
     void UpdateGoal();
+    // thread safe. middle of the gate path.
+    bool FindSpawnPos(FVector& OutVector);
 
 };
 
 
 
-struct FChunkData // dataset for queue.
+// dataset for queue. move only, mesh data goes worker -> queue -> RealtimeMesh without a copy.
+struct FChunkData
 {
     FChunkData() {};
-    FChunkData(const FIntPoint& Chunk, const RealtimeMesh::FRealtimeMeshStreamSet& StreamSet, const TArray<FVector>& ActualPath) :
-        Chunk(Chunk), StreamSet(StreamSet), ActualPath(ActualPath) {};
-    
+    FChunkData(const FIntPoint& Chunk, RealtimeMesh::FRealtimeMeshStreamSet&& StreamSet, TArray<FVector>&& ActualPath, const int32& LOD = 0) :
+        Chunk(Chunk), StreamSet(MoveTemp(StreamSet)), ActualPath(MoveTemp(ActualPath)), LOD(LOD) {};
+
+    FChunkData(FChunkData&&) = default;
+    FChunkData& operator=(FChunkData&&) = default;
+    FChunkData(const FChunkData&) = delete;
+    FChunkData& operator=(const FChunkData&) = delete;
+
     FIntPoint Chunk;
     RealtimeMesh::FRealtimeMeshStreamSet StreamSet;
     TArray<FVector> ActualPath;
+    int32 LOD = 0;
+    int32 MeshBytes = 0;    // StreamSet size.
 };
 
-
-class FPathWorker : public FRunnable
+struct FHorizonData
 {
-
-public:
-    FPathWorker(ALandscapeManager* pLM) {
-        this->pLM = pLM;
-        this->Thread = FRunnableThread::Create(this, TEXT("PathWorkerThread"));
-    };
-    ~FPathWorker();
-
-private:
-
-    virtual bool Init() override;
-    virtual uint32 Run() override;
-    virtual void Exit() override;
-    //virtual void Stop() override;
-
-    
-    FRunnableThread* Thread;
-    bool bShutdown = false;
-
-    ALandscapeManager* pLM;
-    FIntPoint Start;
-    FIntPoint End;
-
-};
\ No newline at end of file
+    FIntPoint Center;
+    int32 StreamRadius = 0;
+    RealtimeMesh::FRealtimeMeshStreamSet StreamSet;
+    float BuildMs = 0.0f;
+};
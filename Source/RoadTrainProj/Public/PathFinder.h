@@ -2,9 +2,114 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Containers/LruCache.h"
+
+#include "HeightCache.h"	// FHeightTilePtr
+
+#include <atomic>
 
 class ALandscapeManager;
-struct FGate;
+
+struct FGate
+{
+    FGate() {};
+    FGate(const FIntPoint& A) : A(A), B(A) {};
+    FGate(const FIntPoint& A, const FIntPoint& B) : A(A), B(B) {};
+    FIntPoint A, B;
+
+    bool operator==(const FGate& Other) const { return A == Other.A && B == Other.B; }
+};
+
+inline uint32 GetTypeHash(const FGate& Gate)
+{
+    return HashCombine(GetTypeHash(Gate.A), GetTypeHash(Gate.B));
+}
+
+// key of a finished GetActualPath. same gates & same entry direction -> same road.
+struct FActualPathKey
+{
+    FGate StartGate;
+    FGate EndGate;
+    FVector2D StartDirection;
+
+    bool operator==(const FActualPathKey& Other) const
+    {
+        return StartGate == Other.StartGate && EndGate == Other.EndGate && StartDirection == Other.StartDirection;
+    }
+};
+
+inline uint32 GetTypeHash(const FActualPathKey& Key)
+{
+    return HashCombine(HashCombine(GetTypeHash(Key.StartGate), GetTypeHash(Key.EndGate)), GetTypeHash(Key.StartDirection));
+}
+
+struct FActualPath
+{
+    TArray<FVector> Path;
+    FVector2D LastDirection;
+};
+
+typedef TSharedPtr<const FActualPath, ESPMode::ThreadSafe> FActualPathPtr;
+
+// traversal cost of one chunk's cells, made once per chunk from its height tile.
+// 8 directions, same order as FPathFinder::GetNeighbors. never changed after it's made.
+struct FCostGrid
+{
+    FIntPoint Chunk;
+    int32 CellNum;      // cells on one side. VerticesPerChunk - 1
+    FHeightTilePtr Tile;
+
+    TArray<float> MoveCosts;        // [Dir * CellNum^2 + Cell]. GetMoveCost without slope penalty.
+    TArray<uint8> SlopeViolations;  // [Cell]. bit Dir is set if tan^2 > MaxSlopeTanSqr
+
+    // (dy + 1) * 3 + (dx + 1) -> Dir
+    static int32 GetDir(const FIntPoint& A, const FIntPoint& B)
+    {
+        static const int32 DirTable[9] = { 0, 1, 2, 3, INDEX_NONE, 4, 5, 6, 7 };
+        return DirTable[(B.Y - A.Y + 1) * 3 + (B.X - A.X + 1)];
+    }
+
+    // A should be in chunk, B next to A. (B can be one cell out of chunk)
+    float GetMoveCost(const FIntPoint& A, const FIntPoint& B) const
+    {
+        return MoveCosts[GetDir(A, B) * CellNum * CellNum + A.Y * CellNum + A.X];
+    }
+
+    bool IsSlopeViolated(const FIntPoint& A, const FIntPoint& B) const
+    {
+        return (SlopeViolations[A.Y * CellNum + A.X] >> GetDir(A, B)) & 1;
+    }
+
+    SIZE_T GetAllocatedSize() const
+    {
+        return sizeof(FCostGrid) + MoveCosts.GetAllocatedSize() + SlopeViolations.GetAllocatedSize();
+    }
+};
+
+typedef TSharedPtr<const FCostGrid, ESPMode::ThreadSafe> FCostGridPtr;
+
+// HPA* abstract graph of one chunk. fixed exits on its edges & costs between them.
+// neighbor chunks pick the same cells on their shared edge, so exits always pair up.
+struct FChunkGraph
+{
+    FIntPoint Chunk;
+    TArray<FGate> Exits;        // global. A is on this chunk's boundary, B is right across in the next chunk.
+    TArray<int32> ExitSides;    // edge of the exit. 0 -X, 1 +X, 2 -Y, 3 +Y
+    TArray<float> CrossCosts;   // cost of stepping A -> B.
+    TArray<float> Costs;        // [From * Exits.Num() + To]. in at From.A, out through To (cross included). INFLOAT if not allowed.
+
+    // exit that has Inside as A. INDEX_NONE if there's none.
+    int32 FindExit(const FIntPoint& Inside) const
+    {
+        for (int32 i = 0; i < Exits.Num(); i++)
+        {
+            if (Exits[i].A == Inside) return i;
+        }
+        return INDEX_NONE;
+    }
+};
+
+typedef TSharedPtr<const FChunkGraph, ESPMode::ThreadSafe> FChunkGraphPtr;
 
 class FPathFinder
 {
@@ -13,8 +118,10 @@ public:
     FPathFinder(ALandscapeManager* pLM);
     // friend ALandscapeManager; // debug
 
-    // HPA*
-    bool GetGatePath(const FIntPoint& StartCell, const FIntPoint& EndCell, TArray<FGate>& OutGatePath);
+    // HPA*. GetGates is the old cell level gate search, only used for debug now.
+    // Cancelled is checked every expansion, false as soon as it's set.
+    // path goes through each chunk once, and never into UsedChunks. (chunks an earlier path already owns)
+    bool GetGatePath(const FIntPoint& StartCell, const FIntPoint& EndCell, TArray<FGate>& OutGatePath, const std::atomic<bool>* Cancelled = nullptr, const TSet<FIntPoint>* UsedChunks = nullptr);
     void GetGates(const FGate& StartGate, const FIntPoint& GlobalGoal, TMap<FIntPoint, TPair<FGate, float>>& OutGates, bool DrawDebug = false);
     bool GetPath(const FGate& StartGate, const FGate& EndGate, TArray<FIntPoint>& OutPath, bool DrawDebug = false);
 
@@ -22,8 +129,13 @@ public:
     void SmoothPath( TArray<FIntPoint>& Path );
     FVector2D RebuildPath(const TArray<FIntPoint>& SmoothPath, TArray<FVector>& OutPath, const FVector2D& StartDirection);
 
-    // macro
+    // macro. cached, thread safe.
     FVector2D GetActualPath(const FGate& StartGate, const FGate& EndGate, TArray<FVector>& OutPath, const FVector2D& StartDirection = FVector2D::ZeroVector);
+    // keys hold both gates & entry direction, so entries stay right when GatePath grows.
+    // only frees memory, on a full regenerate.
+    void EmptyPathCache();
+    int32 GetPathHitCount() const { return PathHitCount; }
+    int32 GetPathMissCount() const { return PathMissCount; }
     
 private:
 
@@ -32,15 +144,43 @@ private:
     float SlopeViolationPanelty;
     float MinTurnRadius;
     float UnitMinTurnRadius;
+    int32 EntrancesPerEdge;
+
+    // cost grids shared by every search & thread.
+    FCriticalSection CostGridMutex;
+    TLruCache<FIntPoint, FCostGridPtr> CostGrids;
+
+    FCostGridPtr GetCostGrid(const FIntPoint& Chunk);
+    FCostGridPtr BuildCostGrid(const FIntPoint& Chunk);
+
+    // abstract graphs, same deal. made lazily when the gate search first reaches the chunk.
+    FCriticalSection ChunkGraphMutex;
+    TLruCache<FIntPoint, FChunkGraphPtr> ChunkGraphs;
+
+    FChunkGraphPtr GetChunkGraph(const FIntPoint& Chunk);
+    FChunkGraphPtr BuildChunkGraph(const FIntPoint& Chunk);
+    void GetChunkExits(const FCostGrid& Grid, TArray<FGate>& OutExits, TArray<int32>& OutSides, TArray<float>& OutCrossCosts);
+    void GetCostField(const FCostGrid& Grid, const FIntPoint& Start, const TArray<FIntPoint>& Targets, TArray<float>& OutCosts);
+    float GetCrossCost(const FCostGrid& Grid, const FIntPoint& Inside, const FIntPoint& Outside);
+
+    // finished roads. MakeChunkData asks for the same ones from up to 9 chunks.
+    FCriticalSection PathMutex;
+    TLruCache<FActualPathKey, FActualPathPtr> ActualPaths;
+    std::atomic<int32> PathHitCount;
+    std::atomic<int32> PathMissCount;
+
+    FActualPathPtr MakeActualPath(const FGate& StartGate, const FGate& EndGate, const FVector2D& StartDirection);
 
     // -----------------tools-----------------
 
-    bool IsWalkable(const FIntPoint& Chunk, const FIntPoint& A, const FIntPoint& B);
+    bool IsWalkable(const FCostGrid& Grid, const FIntPoint& A, const FIntPoint& B);
 
     float GetHeight(const FIntPoint& GlobalGrid);
     float GetHeight(const FIntPoint& Chunk, const FVector2D& Local);
     float GetCellHeight(const FIntPoint& GlobalGrid);
     float GetCellHeight(const FIntPoint& Chunk, const FIntPoint& LocalGrid);
+    float GetCellHeight(const FHeightTile& Tile, const FIntPoint& LocalGrid);
+    float GetHeight(const FHeightTile& Tile, const FVector2D& Local);
     FIntPoint LocalToGlobal(const FIntPoint& Chunk, const FIntPoint& LocalGrid);
     FIntPoint GlobalToLocal(const FIntPoint& Chunk, const FIntPoint& GlobalGrid);
     FVector2D GridToCell(const FIntPoint& Grid);
@@ -49,6 +189,7 @@ private:
     int32 GetFlatIndex(const FIntPoint& Index2D);
     int32 GetFlatIndex( const FIntPoint& Index2D, const int32& RowNum );
     FIntPoint GetIndex2D(const int32& FlatIndex);
+    FIntPoint GetIndex2D(const int32& FlatIndex, const int32& RowNum);
 
     int32 GetUnitDistSqr(const FIntPoint& A, const FIntPoint& B);
     float GetDistSqr(const FVector2D& A, const FVector2D& B);
@@ -63,20 +204,16 @@ private:
     float GetMoveCost(const FIntPoint& A, const FIntPoint& B);
     float GetGlobalMoveCost(const FIntPoint& A, const FIntPoint& B);
     float GetMoveCost(const FIntPoint& Chunk, const FIntPoint& A, const FIntPoint& B);
+    float GetMoveCost(const FHeightTile& Tile, const FIntPoint& A, const FIntPoint& B);
+    float GetMoveCost(const FHeightTile& Tile, const FIntPoint& A, const FIntPoint& B, const float& HeightB);
 
     float GetTanSqr(const FIntPoint& Chunk, const FIntPoint& A, const FIntPoint& B);
+    float GetTanSqr(const FHeightTile& Tile, const FIntPoint& A, const FIntPoint& B);
     float GetTanSqr(const FIntPoint& Chunk, const FVector2D& LocalA, const FVector2D& LocalB);
+    float GetTanSqr(const FHeightTile& Tile, const FVector2D& LocalA, const FVector2D& LocalB);
 
     bool GetCurve(const FVector2D& StartDirection, const FVector2D& Current, const FVector2D& Next, TArray<FVector2D>& OutRoute, 
         const float& TurnRadius = 1500.0f, const float& NoTurnAngle = 5.0f);
     float GetArcAngle(const FVector2D& Center, const FVector2D& Current, const FVector2D& Next, const bool& IsRightTurn, const float& TurnRadius = 1500.0f);
 
 };
-
-struct FGate
-{
-    FGate() {};
-    FGate(const FIntPoint& A) : A(A), B(A) {};
-    FGate(const FIntPoint& A, const FIntPoint& B) : A(A), B(B) {};
-    FIntPoint A, B;
-};
\ No newline at end of file
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "Containers/Queue.h"
+#include "Containers/Ticker.h"	// game thread callbacks
+
+#include <atomic>
+
+// higher goes first. same priority is first in first out.
+enum class EPathJobPriority : uint8
+{
+	Low,	// debug
+	Normal,
+	High,	// gate path extension, the road mustn't run out.
+	Num
+};
+
+// shared by the caller & the service. set Cancelled to drop the job, long searches check it as they go.
+struct FPathJobState
+{
+	std::atomic<bool> Cancelled = false;
+	std::atomic<bool> Done = false;	// callback ran, or never will.
+};
+
+typedef TSharedPtr<FPathJobState, ESPMode::ThreadSafe> FPathJobHandle;
+
+// one long lived thread for path planning. jobs wait in priority queues,
+// results come back on the game thread through the core ticker. (editor too)
+class FPathService : public FRunnable
+{
+
+public:
+	// service thread. false -> nothing to hand back, Done is skipped.
+	typedef TUniqueFunction<bool(const FPathJobState&)> FJobWork;
+	// game thread. skipped if the job was cancelled.
+	typedef TUniqueFunction<void()> FJobDone;
+
+	FPathService(const EThreadPriority& Priority = TPri_BelowNormal);
+	// cancels everything & joins. callbacks not delivered yet are thrown away.
+	~FPathService();
+
+	// thread safe.
+	FPathJobHandle Enqueue(const EPathJobPriority& Priority, FJobWork&& Work, FJobDone&& Done = nullptr);
+
+	// Work fills a ResultType, Done gets it on the game thread.
+	template<typename ResultType>
+	FPathJobHandle Enqueue(const EPathJobPriority& Priority, TUniqueFunction<bool(const FPathJobState&, ResultType&)>&& Work, TUniqueFunction<void(ResultType&&)>&& Done)
+	{
+		TSharedRef<ResultType, ESPMode::ThreadSafe> Result = MakeShared<ResultType, ESPMode::ThreadSafe>();
+		return Enqueue(Priority,
+			[Result, Work = MoveTemp(Work)](const FPathJobState& State) mutable { return Work(State, *Result); },
+			[Result, Done = MoveTemp(Done)]() mutable { Done(MoveTemp(*Result)); });
+	}
+
+	int32 GetQueueLength() const { return QueueLength; }
+	float GetAverageLatencyMs() const { return AverageLatencyMs; }
+
+private:
+	struct FJob
+	{
+		FPathJobHandle State;
+		double EnqueueTime = 0.0;
+		FJobWork Work;
+		FJobDone Done;
+		bool HasResult = false;
+	};
+
+	// O(1) push & pop. Mutex keeps pops in step with Running & the destructor's cancel.
+	FCriticalSection Mutex;
+	TQueue<FJob, EQueueMode::Mpsc> Queues[int32(EPathJobPriority::Num)];
+	FPathJobHandle Running;
+	std::atomic<int32> QueueLength;
+
+	// service thread -> game thread.
+	TQueue<FJob, EQueueMode::Spsc> Finished;
+
+	FEvent* WorkEvent;
+	std::atomic<bool> ShouldStop;
+	FRunnableThread* Thread;
+
+	// game thread only.
+	FTSTicker::FDelegateHandle TickerHandle;
+	float AverageLatencyMs = 0.0f;	// enqueue -> result on the game thread.
+
+	bool PopJob(FJob& OutJob);
+	bool Tick(float DeltaTime);
+
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+// distance to the road & height of the nearest road point, on a grid of samples.
+// made once per chunk build from the road polyline, then every query is one array read.
+// sample (x, y) is at (Min + (x, y)) * Spacing, global.
+struct FRoadField
+{
+	FIntPoint Min = FIntPoint(0, 0);
+	FIntPoint Num = FIntPoint(0, 0);
+	float Spacing = 1.0f;
+
+	TArray<FVector> Points;			// road polyline, resampled to Spacing. global.
+	TArray<float> Distances;		// to the nearest of Points. infinity if there's no road.
+	TArray<float> RoadHeights;		// Z of the nearest of Points.
+
+	// Points from InPath (gaps longer than MaxGap are left open), then the exact euclidean distance transform.
+	void Build(const TArray<FVector>& InPath, const FIntPoint& InMin, const FIntPoint& InNum, const float& InSpacing, const float& MaxGap);
+
+	bool IsEmpty() const { return Distances.IsEmpty(); }
+	// empty, but keeps the memory for the next Build.
+	void Reset();
+
+	// Grid is global sample coord. false if it's out of the field.
+	bool Contains(const FIntPoint& Grid) const
+	{
+		FIntPoint Local = Grid - Min;
+		return Local.X >= 0 && Local.Y >= 0 && Local.X < Num.X && Local.Y < Num.Y;
+	}
+
+	float GetDistance(const FIntPoint& Grid) const { return Distances[GetFlatIndex(Grid)]; }
+	float GetRoadHeight(const FIntPoint& Grid) const { return RoadHeights[GetFlatIndex(Grid)]; }
+	// < 0 on the road itself.
+	float GetSignedDistance(const FIntPoint& Grid, const float& HalfWidth) const { return GetDistance(Grid) - HalfWidth; }
+	// for placing things (grass, props). out of the field counts as far from road.
+	bool IsNearRoad(const FIntPoint& Grid, const float& Margin) const { return Contains(Grid) && GetDistance(Grid) <= Margin; }
+
+private:
+	int32 GetFlatIndex(const FIntPoint& Grid) const { return (Grid.Y - Min.Y) * Num.X + (Grid.X - Min.X); }
+
+	// Build scratch. kept, so a reused field doesn't allocate.
+	TArray<int32> Seeds, ColumnSeed, Args, V;
+	TArray<float> SeedDistSqr, ColumnDist, F, D, Z;
+};
@@ -3,4 +3,7 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Stats/Stats.h"
 
+// stat RoadTrain
+DECLARE_STATS_GROUP(TEXT("RoadTrain"), STATGROUP_RoadTrain, STATCAT_Advanced);